@@ -1,4 +1,22 @@
 #pragma once
 
 #include "array_wrapper/array_wrapper_cpu.h"
-#include "array_wrapper/array_wrapper_gpu.h"
\ No newline at end of file
+#include "array_wrapper/array_wrapper_gpu.h"
+#include "array_wrapper/pool_allocator.h"
+#include "array_wrapper/huge_page_allocator.h"
+#include "array_wrapper/numa_allocator.h"
+#include "array_wrapper/kernel.h"
+#include "array_wrapper/expression.h"
+#include "array_wrapper/reduction.h"
+#include "array_wrapper/view.h"
+#include "array_wrapper/field_bundle.h"
+#include "array_wrapper/tracked_allocator.h"
+#include "array_wrapper/copy_engine.h"
+#include "array_wrapper/copy_queue.h"
+#include "array_wrapper/cow_array.h"
+#include "array_wrapper/resizable_array.h"
+#include "array_wrapper/memory_resource.h"
+#include "array_wrapper/scratch_arena.h"
+#include "array_wrapper/reduced_precision.h"
+#include "array_wrapper/anderson.h"
+#include "array_wrapper/owning_history.h"
\ No newline at end of file
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "boost/align.hpp"
+#include "../parallel.h"
+#include "../history.h"
+#include "array_wrapper_cpu.h"
+#include "kernel.h"
+#include "reduction.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace anderson {
+			namespace detail {
+				//pseudo-inverse solve of the symmetric positive semi-definite system U c = v of size m by cyclic Jacobi rotations
+				//U is equilibrated by its diagonal first, eigenvalues below rcond times the largest one are dropped
+				inline std::vector<double> solve(std::vector<double> U, std::vector<double> v, std::size_t m, double rcond) {
+					std::vector<double> d(m), V(m * m, 0.0), c(m, 0.0);
+					for (std::size_t i = 0; i < m; ++i) {
+						d[i] = U[i * m + i] > 0 ? 1.0 / std::sqrt(U[i * m + i]) : 0.0;
+						V[i * m + i] = 1.0;
+					}
+					for (std::size_t i = 0; i < m; ++i) {
+						v[i] *= d[i];
+						for (std::size_t j = 0; j < m; ++j) U[i * m + j] *= d[i] * d[j];
+					}
+					for (int sweep = 0; sweep < 50; ++sweep) {
+						double off = 0, diag = 0;
+						for (std::size_t i = 0; i < m; ++i) {
+							diag += U[i * m + i] * U[i * m + i];
+							for (std::size_t j = i + 1; j < m; ++j) off += U[i * m + j] * U[i * m + j];
+						}
+						if (off <= 1e-30 * diag) break;
+						for (std::size_t p = 0; p < m; ++p) {
+							for (std::size_t q = p + 1; q < m; ++q) {
+								double upq = U[p * m + q];
+								if (upq == 0) continue;
+								double theta = (U[q * m + q] - U[p * m + p]) / (2 * upq);
+								double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+								double cs = 1 / std::sqrt(t * t + 1), sn = t * cs;
+								for (std::size_t k = 0; k < m; ++k) {
+									double ukp = U[k * m + p], ukq = U[k * m + q];
+									U[k * m + p] = cs * ukp - sn * ukq;
+									U[k * m + q] = sn * ukp + cs * ukq;
+								}
+								for (std::size_t k = 0; k < m; ++k) {
+									double upk = U[p * m + k], uqk = U[q * m + k];
+									U[p * m + k] = cs * upk - sn * uqk;
+									U[q * m + k] = sn * upk + cs * uqk;
+								}
+								for (std::size_t k = 0; k < m; ++k) {
+									double vkp = V[k * m + p], vkq = V[k * m + q];
+									V[k * m + p] = cs * vkp - sn * vkq;
+									V[k * m + q] = sn * vkp + cs * vkq;
+								}
+							}
+						}
+					}
+					double lambda_max = 0;
+					for (std::size_t i = 0; i < m; ++i) lambda_max = U[i * m + i] > lambda_max ? U[i * m + i] : lambda_max;
+					for (std::size_t k = 0; k < m; ++k) {
+						double lambda = U[k * m + k];
+						if (lambda <= rcond * lambda_max) continue;
+						double proj = 0;
+						for (std::size_t i = 0; i < m; ++i) proj += V[i * m + k] * v[i];
+						proj /= lambda;
+						for (std::size_t i = 0; i < m; ++i) c[i] += proj * V[i * m + k];
+					}
+					for (std::size_t i = 0; i < m; ++i) c[i] *= d[i];
+					return c;
+				}
+			}
+		}
+
+		//Anderson mixing (DIIS) over the last N_hist pairs of fields and residuals
+		//the Gram matrix of the residual records is kept by ring slot, push() only computes the row and column of the new record
+		//in the same pass that copies it in, and mix() reads every record once to form the mixed field
+		//the mixed field is sum_i alpha_i (w_i + beta r_i), where sum_i alpha_i = 1 and alpha minimizes |sum_i alpha_i r_i|
+		template<class T, class Allocator, size_t A>
+		class AndersonMixing {
+			static_assert(std::is_floating_point<T>::value, "Anderson mixing is only provided for real fields");
+		public:
+			using array_type = ArrayCPU<T, Allocator, A>;
+			//blocks of the fused passes, identical to those of reduction so that the Gram matrix does not depend on n_threads
+			constexpr static std::size_t block_size = reduction::block_size;
+
+			AndersonMixing() = delete;
+			AndersonMixing(std::size_t single_size, std::size_t N_hist, std::size_t n_threads = 0)
+				: single_size_(checked_single_size(single_size, N_hist)), N_hist_(N_hist), n_threads_(n_threads),
+				fields_data_(N_hist * single_size, uninitialized), residuals_data_(N_hist * single_size, uninitialized),
+				fields_(fields_data_.pointer(), single_size, N_hist), residuals_(residuals_data_.pointer(), single_size, N_hist),
+				gram_(N_hist * N_hist, 0.0), alpha_() {}
+			AndersonMixing(const AndersonMixing&) = delete;
+			AndersonMixing& operator=(const AndersonMixing&) = delete;
+
+			//records a field and its residual
+			void push(const T* field, const T* residual) {
+				std::size_t slot = residuals_.pos();
+				std::size_t n_records = residuals_.available() < N_hist_ ? residuals_.available() + 1 : N_hist_;
+				std::size_t n_blocks = (single_size_ + block_size - 1) / block_size;
+				std::vector<double> partials(n_blocks * n_records);
+				T* w = fields_.current();
+				T* r = residuals_.current();
+				const T* base = residuals_.cbegin();
+				parallel::for_each_chunk(n_blocks, n_threads_, [&](std::size_t, std::size_t block_begin, std::size_t block_end) {
+					for (std::size_t b = block_begin; b < block_end; ++b) {
+						std::size_t begin = b * block_size;
+						std::size_t n = (begin + block_size < single_size_ ? begin + block_size : single_size_) - begin;
+						std::memcpy(w + begin, field + begin, sizeof(T) * n);
+						std::memcpy(r + begin, residual + begin, sizeof(T) * n);
+						//the new block is still in cache while it is dotted with the other records
+						for (std::size_t j = 0; j < n_records; ++j)
+							partials[b * n_records + j] = kernel::dot(n, r + begin, base + j * single_size_ + begin);
+					}
+					});
+				for (std::size_t j = 0; j < n_records; ++j) {
+					double g = 0;
+					for (std::size_t b = 0; b < n_blocks; ++b) g += partials[b * n_records + j];
+					gram_[slot * N_hist_ + j] = gram_[j * N_hist_ + slot] = g;
+				}
+				fields_.push();
+				residuals_.push();
+			}
+			template <class Alloc1, class Alloc2>
+			void push(const ArrayCPU<T, Alloc1, A>& field, const ArrayCPU<T, Alloc2, A>& residual) {
+				if (field.size_ != single_size_ || residual.size_ != single_size_)
+					throw std::logic_error("push can not be done with arrays of a different size than the records");
+				push(field.pointer(), residual.pointer());
+			}
+
+			//writes the mixed field into out, beta is the weight of the residuals
+			void mix(T* out, T beta) {
+				std::size_t n_records = residuals_.available();
+				if (n_records == 0) throw std::logic_error("mix requires at least one record");
+				solve();
+				std::size_t n_blocks = (single_size_ + block_size - 1) / block_size;
+				const T* w = fields_.cbegin();
+				const T* r = residuals_.cbegin();
+				parallel::for_each_chunk(n_blocks, n_threads_, [&](std::size_t, std::size_t block_begin, std::size_t block_end) {
+					for (std::size_t b = block_begin; b < block_end; ++b) {
+						std::size_t begin = b * block_size;
+						std::size_t n = (begin + block_size < single_size_ ? begin + block_size : single_size_) - begin;
+						kernel::scaled_copy(n, static_cast<T>(alpha_[0]), w + begin, out + begin);
+						kernel::axpy(n, static_cast<T>(alpha_[0] * beta), r + begin, out + begin);
+						for (std::size_t j = 1; j < n_records; ++j) {
+							kernel::axpy(n, static_cast<T>(alpha_[j]), w + j * single_size_ + begin, out + begin);
+							kernel::axpy(n, static_cast<T>(alpha_[j] * beta), r + j * single_size_ + begin, out + begin);
+						}
+					}
+					});
+			}
+			template <class Alloc>
+			void mix(ArrayCPU<T, Alloc, A>& out, T beta) {
+				if (out.size_ != single_size_) throw std::logic_error("mix can not be done into an array of a different size than the records");
+				mix(out.pointer(), beta);
+			}
+
+			//forgets all records, e.g. after a large change of the fields
+			void reset() noexcept {
+				fields_.reset();
+				residuals_.reset();
+			}
+
+			//relative cutoff of the eigenvalues of the least-squares system
+			void set_rcond(double rcond) noexcept { rcond_ = rcond; }
+			[[nodiscard]] double rcond() const noexcept { return rcond_; }
+
+			//coefficients alpha of the last mix(), indexed by ring slot
+			[[nodiscard]] const std::vector<double>& coefficients() const noexcept { return alpha_; }
+			//inner product of the residuals stored in ring slots i and j
+			[[nodiscard]] double gram(std::size_t i, std::size_t j) const { return gram_.at(i * N_hist_ + j); }
+
+			[[nodiscard]] const history::DHistory<T>& fields() const noexcept { return fields_; }
+			[[nodiscard]] const history::DHistory<T>& residuals() const noexcept { return residuals_; }
+			[[nodiscard]] std::size_t available() const noexcept { return residuals_.available(); }
+			[[nodiscard]] std::size_t single_size() const noexcept { return single_size_; }
+			[[nodiscard]] std::size_t N_hist() const noexcept { return N_hist_; }
+
+		private:
+			//checked in the first member initializer, before the records are allocated
+			static std::size_t checked_single_size(std::size_t single_size, std::size_t N_hist) {
+				if (N_hist == 0) throw std::invalid_argument("Anderson mixing requires at least one record");
+				if (single_size == 0) throw std::invalid_argument("Anderson mixing requires records of at least one element");
+				return single_size;
+			}
+
+			//alpha of the newest record is 1 - sum(c), the others are c, which minimizes |r_k - sum_i c_i (r_k - r_i)|
+			//the differences are formed from the Gram matrix of the records, so nothing is read from the records here
+			void solve() {
+				std::size_t n_records = residuals_.available();
+				std::size_t k = (residuals_.pos() + N_hist_ - 1) % N_hist_;
+				alpha_.assign(n_records, 0.0);
+				alpha_[k] = 1.0;
+				if (n_records == 1) return;
+				std::vector<std::size_t> others;
+				for (std::size_t i = 0; i < n_records; ++i)
+					if (i != k) others.push_back(i);
+				std::size_t m = others.size();
+				auto g = [&](std::size_t i, std::size_t j) { return gram_[i * N_hist_ + j]; };
+				std::vector<double> U(m * m), v(m);
+				for (std::size_t a = 0; a < m; ++a) {
+					v[a] = g(k, k) - g(k, others[a]);
+					for (std::size_t b = 0; b < m; ++b)
+						U[a * m + b] = g(k, k) - g(k, others[a]) - g(k, others[b]) + g(others[a], others[b]);
+				}
+				auto c = anderson::detail::solve(std::move(U), std::move(v), m, rcond_);
+				for (std::size_t a = 0; a < m; ++a) {
+					alpha_[others[a]] = c[a];
+					alpha_[k] -= c[a];
+				}
+			}
+
+			const std::size_t single_size_;
+			const std::size_t N_hist_;
+			const std::size_t n_threads_;
+			array_type fields_data_;
+			array_type residuals_data_;
+			history::DHistory<T> fields_;
+			history::DHistory<T> residuals_;
+			std::vector<double> gram_;
+			std::vector<double> alpha_;
+			double rcond_ = 1e-12;
+		};
+
+		template <class T, std::size_t A = 64>
+		using DAndersonMixingDDR = AndersonMixing<T, boost::alignment::aligned_allocator<T, A>, A>;
+	}
+}
@@ -1,10 +1,13 @@
 ﻿#pragma once
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <stdexcept>
+#include <type_traits>
 #include <vector>
 #include "boost/align.hpp"
+#include "../parallel.h"
 #include "detail.h"
 #include "hbw_posix_allocator.h"
 
@@ -13,26 +16,83 @@ namespace qutility {
 
 		class ArrayCPUBase {};
 
+		//base of the lazy expressions in expression.h, assigning one to an ArrayCPU evaluates it in a single pass
+		class ExpressionBase {};
+
+		//buffer type adopted by ArrayCPU without copying
+		//a std::vector<T, Allocator> can not hand its buffer to a vector of another allocator type, so build the data in this type
+		template <class T, class Allocator>
+		using ArrayStorage = std::vector<T, detail::default_init_allocator<Allocator>>;
+
+		//tag: elements are default-initialized, i.e. left untouched if T is trivially default constructible
+		struct uninitialized_t { explicit uninitialized_t() = default; };
+		inline constexpr uninitialized_t uninitialized{};
+
+		//tag: elements are initialized in parallel, thread i writing the i-th chunk given by parallel::for_each_chunk
+		//pages are thus placed on the NUMA node the touching thread runs on at that moment
+		//the threads are neither persistent nor pinned, so later compute loops only find their chunk local if the OS
+		//schedules them on the same nodes, pin the threads (e.g. OMP_PROC_BIND or numactl) to make this reliable
+		//arrays smaller than serial_below bytes are initialized by the calling thread, where starting threads would cost more than it saves
+		//note that this only pays off for trivially default constructible T, otherwise the constructing thread touches all elements first
+		struct first_touch_t {
+			constexpr static std::size_t serial_below = std::size_t(1) << 20;
+			std::size_t n_threads = 0;
+			[[nodiscard]] constexpr std::size_t threads_for(std::size_t bytes) const noexcept { return bytes < serial_below ? 1 : n_threads; }
+		};
+		inline constexpr first_touch_t first_touch{};
+
 		template<class T, class Allocator, size_t A>
 		class ArrayCPU : ArrayCPUBase {
 		public:
+			using allocator_type = detail::default_init_allocator<Allocator>;
+			using storage_type = ArrayStorage<T, Allocator>;
+
 			ArrayCPU() = delete;
-			ArrayCPU(std::size_t S) : data_(S, T()), size_(S), pointer_(&(data_.at(0))) {	}
-			ArrayCPU(const T& val, std::size_t S) : data_(S, val), size_(S), pointer_(&(data_.at(0))) {	}
+			ArrayCPU(std::size_t S) : size_(S), data_(S, T()), pointer_(&(data_.at(0))) {	}
+			ArrayCPU(const T& val, std::size_t S) : size_(S), data_(S, val), pointer_(&(data_.at(0))) {	}
+			ArrayCPU(std::size_t S, uninitialized_t) : size_(S), data_(S), pointer_(&(data_.at(0))) {	}
+			ArrayCPU(std::size_t S, first_touch_t ft) : ArrayCPU(T(), S, ft) {	}
+			ArrayCPU(const T& val, std::size_t S, first_touch_t ft) : ArrayCPU(S, uninitialized) {
+				parallel::for_each_chunk(S, ft.threads_for(S * sizeof(T)), [this, &val](std::size_t, std::size_t begin, std::size_t end) {
+					std::fill(pointer_ + begin, pointer_ + end, val);
+					});
+			}
 			template<typename OtherT, typename OtherAlloc>
-			ArrayCPU(const std::vector<OtherT, OtherAlloc>& v, std::size_t S) : data_(detail::duplicate<T, Allocator>(v, S)), size_(S), pointer_(&(data_.at(0))) {			}
-			ArrayCPU(const ArrayCPU& rhs) : data_(rhs.data_), size_(rhs.size_), pointer_(&(data_.at(0))) {	}
-			ArrayCPU(ArrayCPU&& rhs) : data_(std::move(rhs.data_)), size_(rhs.size_), pointer_(&(data_.at(0))) {	}
+			ArrayCPU(const std::vector<OtherT, OtherAlloc>& v, std::size_t S) : size_(S), data_(detail::duplicate<T, allocator_type>(v, S)), pointer_(&(data_.at(0))) {			}
+			//adopt the buffer of v without copying, v is resized to S beforehand if necessary, see ArrayStorage
+			ArrayCPU(storage_type&& v, std::size_t S) : size_(S), data_(detail::adopt(std::move(v), S)), pointer_(&(data_.at(0))) {	}
+			ArrayCPU(storage_type&& v) : size_(v.size()), data_(std::move(v)), pointer_(&(data_.at(0))) {	}
+			ArrayCPU(const ArrayCPU& rhs) : size_(rhs.size_), data_(rhs.data_), pointer_(&(data_.at(0))) {	}
+			//the buffer of rhs is stolen, rhs is left without storage: pointer() is nullptr while size_ keeps its value
+			//a moved-from array may only be destroyed, assignments and swaps involving it throw
+			ArrayCPU(ArrayCPU&& rhs) : size_(rhs.size_), data_(std::move(rhs.data_)), pointer_(&(data_.at(0))) { rhs.pointer_ = nullptr; }
 			ArrayCPU& operator=(const ArrayCPU& rhs) {
+				check_storage(rhs);
 				if (size_ < rhs.size_) throw std::logic_error("Assignment can not be done from a larger array to a smaller one");
 				std::memcpy(pointer_, rhs.pointer(), sizeof(T) * rhs.size_);
 				return *this;
 			}
+			//buffers are exchanged in O(1) if the sizes match, otherwise the content of rhs is copied as in the copy assignment
 			ArrayCPU& operator=(ArrayCPU&& rhs) {
+				check_storage(rhs);
+				if (size_ == rhs.size_) return swap(rhs);
 				if (size_ < rhs.size_) throw std::logic_error("Assignment can not be done from a larger array to a smaller one");
 				std::memcpy(pointer_, rhs.pointer(), sizeof(T) * rhs.size_);
 				return *this;
 			}
+			template <class E, class = std::enable_if_t<std::is_base_of<ExpressionBase, E>::value>>
+			ArrayCPU& operator=(const E& e) {
+				check_storage(*this);
+				assign(*this, e);
+				return *this;
+			}
+			ArrayCPU& swap(ArrayCPU& rhs) {
+				check_storage(rhs);
+				if (size_ != rhs.size_) throw std::logic_error("Swap can not be done between two arrays of different sizes");
+				data_.swap(rhs.data_);
+				std::swap(pointer_, rhs.pointer_);
+				return *this;
+			}
 
 			operator T* () { return pointer_; }
 			operator const T* () const { return pointer_; }
@@ -48,13 +108,69 @@ namespace qutility {
 			inline T& operator[](size_t pos) { return data_[pos]; }
 
 		protected:
-			std::vector<T, Allocator> data_;
-			T* const pointer_;
+			void check_storage(const ArrayCPU& rhs) const {
+				if (pointer_ == nullptr || rhs.pointer_ == nullptr) throw std::logic_error("A moved-from array can not be assigned or swapped");
+			}
+
+			storage_type data_;
+			T* pointer_;
+		};
+
+		template<class T, class Allocator, size_t A>
+		void swap(ArrayCPU<T, Allocator, A>& lhs, ArrayCPU<T, Allocator, A>& rhs) {
+			lhs.swap(rhs);
+		}
+
+		//non-owning view of a contiguous range with the interface of ArrayCPU
+		//copy construction rebinds the view, assignment copies the content as for ArrayCPU
+		template<class T, size_t A>
+		class ArrayCPUView : ArrayCPUBase {
+		public:
+			ArrayCPUView() = delete;
+			ArrayCPUView(T* pointer, std::size_t S) : size_(S), pointer_(pointer) {	}
+			template<class Allocator>
+			ArrayCPUView(ArrayCPU<std::remove_const_t<T>, Allocator, A>& arr) : size_(arr.size_), pointer_(arr.pointer()) {	}
+			template<class Allocator, class U = T, class = std::enable_if_t<std::is_const<U>::value>>
+			ArrayCPUView(const ArrayCPU<std::remove_const_t<T>, Allocator, A>& arr) : size_(arr.size_), pointer_(arr.pointer()) {	}
+			ArrayCPUView(const ArrayCPUView&) = default;
+			template<class U, class = std::enable_if_t<std::is_same<const U, T>::value>>
+			ArrayCPUView(const ArrayCPUView<U, A>& rhs) : size_(rhs.size_), pointer_(rhs.pointer()) {	}
+			ArrayCPUView& operator=(const ArrayCPUView& rhs) {
+				if (size_ < rhs.size_) throw std::logic_error("Assignment can not be done from a larger array to a smaller one");
+				std::memcpy(pointer_, rhs.pointer(), sizeof(T) * rhs.size_);
+				return *this;
+			}
+			template<class Allocator>
+			ArrayCPUView& operator=(const ArrayCPU<std::remove_const_t<T>, Allocator, A>& rhs) {
+				if (size_ < rhs.size_) throw std::logic_error("Assignment can not be done from a larger array to a smaller one");
+				std::memcpy(pointer_, rhs.pointer(), sizeof(T) * rhs.size_);
+				return *this;
+			}
+			template <class E, class = std::enable_if_t<std::is_base_of<ExpressionBase, E>::value>>
+			ArrayCPUView& operator=(const E& e) {
+				assign(*this, e);
+				return *this;
+			}
+
+			operator T* () const { return pointer_; }
+			T* operator+(size_t shift) const { return pointer_ + shift; }
+
+			const std::size_t size_;
+			constexpr static std::size_t Alignment = A;
+
+			inline T* pointer() const { return pointer_; }
+			inline T& operator[](size_t pos) const { return pointer_[pos]; }
+
+		private:
+			T* pointer_;
 		};
 
 		template <class T, std::size_t A = 64>
 		using DArrayDDR = ArrayCPU<T, boost::alignment::aligned_allocator<T, A>, A>;
 
+		template <class T, std::size_t A = 64>
+		using DArrayDDRStorage = ArrayStorage<T, boost::alignment::aligned_allocator<T, A>>;
+
 		template <class T, std::size_t A = 64>
 		using DArrayHBW = ArrayCPU<T, hbw::allocator<T, A>, A>;
 
@@ -63,12 +179,17 @@ namespace qutility {
 		public:
 			ArrayDDR() : DArrayDDR<T, A>(S) {	}
 			ArrayDDR(const T& val) : DArrayDDR<T, A>(val, S) {	}
+			ArrayDDR(uninitialized_t) : DArrayDDR<T, A>(S, uninitialized) {}
+			ArrayDDR(first_touch_t ft) : DArrayDDR<T, A>(S, ft) {}
+			ArrayDDR(const T& val, first_touch_t ft) : DArrayDDR<T, A>(val, S, ft) {}
 			template<typename OtherT, typename OtherAlloc>
 			ArrayDDR(const std::vector<OtherT, OtherAlloc>& v) : DArrayDDR<T, A>(v, S) {}
+			ArrayDDR(typename DArrayDDR<T, A>::storage_type&& v) : DArrayDDR<T, A>(std::move(v), S) {}
 			ArrayDDR(const ArrayDDR&) = default;
 			ArrayDDR(ArrayDDR&&) = default;
 			ArrayDDR& operator=(const ArrayDDR&) = default;
 			ArrayDDR& operator=(ArrayDDR&&) = default;
+			using DArrayDDR<T, A>::operator=;
 
 			constexpr static std::size_t Size = S;
 		};
@@ -78,15 +199,65 @@ namespace qutility {
 		public:
 			ArrayHBW() : DArrayHBW<T, A>(S) { }
 			ArrayHBW(const T& val) : DArrayHBW<T, A>(val, S) { }
+			ArrayHBW(uninitialized_t) : DArrayHBW<T, A>(S, uninitialized) {}
+			ArrayHBW(first_touch_t ft) : DArrayHBW<T, A>(S, ft) {}
+			ArrayHBW(const T& val, first_touch_t ft) : DArrayHBW<T, A>(val, S, ft) {}
 			template<typename OtherT, typename OtherAlloc>
 			ArrayHBW(const std::vector<OtherT, OtherAlloc>& v) : DArrayHBW<T, A>(v, S) {}
+			ArrayHBW(typename DArrayHBW<T, A>::storage_type&& v) : DArrayHBW<T, A>(std::move(v), S) {}
 			ArrayHBW(const ArrayHBW&) = default;
 			ArrayHBW(ArrayHBW&&) = default;
 			ArrayHBW& operator=(const ArrayHBW&) = default;
 			ArrayHBW& operator=(ArrayHBW&&) = default;
+			using DArrayHBW<T, A>::operator=;
 
 			constexpr static std::size_t Size = S;
 		};
 
+		//fixed size array with aligned inline storage, for small buffers that should not touch the allocator
+		//size_ is a compile time constant as well, so that array_copy and the other functions reading size_ accept it
+		template <class T, std::size_t S, std::size_t A = 64>
+		class ArrayInline : ArrayCPUBase {
+			static_assert(S > 0, "ArrayInline can not be empty");
+		public:
+			ArrayInline() : data_() {	}
+			ArrayInline(const T& val) { std::fill(data_, data_ + S, val); }
+			ArrayInline(uninitialized_t) {	}
+			template<typename OtherT, typename OtherAlloc>
+			ArrayInline(const std::vector<OtherT, OtherAlloc>& v) : data_() {
+				std::copy(v.cbegin(), v.cbegin() + (S < v.size() ? S : v.size()), data_);
+			}
+			ArrayInline(const ArrayInline&) = default;
+			ArrayInline& operator=(const ArrayInline&) = default;
+			template<class Allocator>
+			ArrayInline& operator=(const ArrayCPU<T, Allocator, A>& rhs) {
+				if (S < rhs.size_) throw std::logic_error("Assignment can not be done from a larger array to a smaller one");
+				std::memcpy(data_, rhs.pointer(), sizeof(T) * rhs.size_);
+				return *this;
+			}
+			template <class E, class = std::enable_if_t<std::is_base_of<ExpressionBase, E>::value>>
+			ArrayInline& operator=(const E& e) {
+				ArrayCPUView<T, A>(data_, S) = e;
+				return *this;
+			}
+
+			operator T* () { return data_; }
+			operator const T* () const { return data_; }
+			T* operator+(size_t shift) { return data_ + shift; }
+			const T* operator+(size_t shift) const { return data_ + shift; }
+
+			constexpr static std::size_t size_ = S;
+			constexpr static std::size_t Size = S;
+			constexpr static std::size_t Alignment = A;
+
+			inline const T* pointer() const { return data_; }
+			inline T* pointer() { return data_; }
+			inline const T& operator[](size_t pos) const { return data_[pos]; }
+			inline T& operator[](size_t pos) { return data_[pos]; }
+
+		protected:
+			alignas(A) T data_[S];
+		};
+
 	}
 }
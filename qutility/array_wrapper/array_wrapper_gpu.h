@@ -7,6 +7,7 @@
 #include "helper_cuda.h"
 #include "thrust/device_vector.h"
 #include "detail.h"
+#include "copy_engine.h"
 
 namespace qutility {
 	namespace array_wrapper {
@@ -140,13 +141,13 @@ namespace qutility {
 			using ValTy = std::decay_t<std::remove_pointer_t< decltype(std::declval<SrcArrayT>().pointer())>>;
 			if (dst.size_ < (src.size_ + shift)) throw std::logic_error("array_copy can not be done from a larger array to a smaller one");
 			if constexpr (std::is_base_of<ArrayCPUBase, DstArrayT>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value)
-				std::memcpy(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_);
+				copy_engine::copy(dst.pointer() + shift, src.pointer(), src.size_);
 			else if constexpr (std::is_base_of<ArrayGPUBase, DstArrayT>::value && std::is_base_of<ArrayGPUBase, SrcArrayT>::value)
-				checkCudaErrors(cudaMemcpy(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToDevice));
+				checkCudaErrors(cudaMemcpy(dst.pointer() + shift, src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToDevice));
 			else if constexpr (std::is_base_of<ArrayCPUBase, DstArrayT>::value && std::is_base_of<ArrayGPUBase, SrcArrayT>::value)
-				checkCudaErrors(cudaMemcpy(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToHost));
+				checkCudaErrors(cudaMemcpy(dst.pointer() + shift, src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToHost));
 			else if constexpr (std::is_base_of<ArrayGPUBase, DstArrayT>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value)
-				checkCudaErrors(cudaMemcpy(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyHostToDevice));
+				checkCudaErrors(cudaMemcpy(dst.pointer() + shift, src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyHostToDevice));
 		}
 
 		template<
@@ -164,13 +165,13 @@ namespace qutility {
 			using ValTy = std::decay_t<std::remove_pointer_t< decltype(std::declval<SrcArrayT>().pointer())>>;
 			if (dst.size_ < (src.size_ + shift)) throw std::logic_error("array_copy can not be done from a larger array to a smaller one");
 			if constexpr (std::is_base_of<ArrayCPUBase, DstArrayT>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value)
-				checkCudaErrors(cudaMemcpyAsync(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyHostToHost, stream));
+				checkCudaErrors(cudaMemcpyAsync(dst.pointer() + shift, src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyHostToHost, stream));
 			else if constexpr (std::is_base_of<ArrayGPUBase, DstArrayT>::value && std::is_base_of<ArrayGPUBase, SrcArrayT>::value)
-				checkCudaErrors(cudaMemcpyAsync(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToDevice, stream));
+				checkCudaErrors(cudaMemcpyAsync(dst.pointer() + shift, src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToDevice, stream));
 			else if constexpr (std::is_base_of<ArrayCPUBase, DstArrayT>::value && std::is_base_of<ArrayGPUBase, SrcArrayT>::value)
-				checkCudaErrors(cudaMemcpyAsync(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToHost, stream));
+				checkCudaErrors(cudaMemcpyAsync(dst.pointer() + shift, src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyDeviceToHost, stream));
 			else if constexpr (std::is_base_of<ArrayGPUBase, DstArrayT>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value)
-				checkCudaErrors(cudaMemcpyAsync(dst.pointer(), src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyHostToDevice, stream));
+				checkCudaErrors(cudaMemcpyAsync(dst.pointer() + shift, src.pointer(), sizeof(ValTy) * src.size_, cudaMemcpyHostToDevice, stream));
 		}
 	}
 }
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <boost/predef.h>
+#include "../parallel.h"
+#include "array_wrapper_cpu.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define QUTILITY_COPY_ENGINE_STREAMING
+#endif
+
+#if BOOST_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace copy_engine {
+			//copies smaller than this are done by a single memcpy on the calling thread
+			constexpr std::size_t parallel_threshold = std::size_t(1) << 20;
+			//every thread gets at least this many bytes, a few threads already saturate the memory bandwidth
+			constexpr std::size_t min_bytes_per_thread = std::size_t(1) << 20;
+
+			namespace detail {
+				inline std::size_t last_level_cache_size() {
+#if BOOST_OS_LINUX && defined(_SC_LEVEL3_CACHE_SIZE)
+					long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+					if (size > 0) return static_cast<std::size_t>(size);
+#endif
+					return std::size_t(32) << 20;
+				}
+
+				inline std::atomic<std::size_t>& streaming_threshold() {
+					static std::atomic<std::size_t> threshold{ last_level_cache_size() };
+					return threshold;
+				}
+
+				//memcpy with non-temporal stores, so that the destination does not evict the working set from the caches
+				inline void stream_copy(void* dst, const void* src, std::size_t bytes) {
+#ifdef QUTILITY_COPY_ENGINE_STREAMING
+					auto d = static_cast<char*>(dst);
+					auto s = static_cast<const char*>(src);
+					//the head up to the next 64-byte boundary of dst goes through the cache
+					std::size_t head = (64 - reinterpret_cast<std::uintptr_t>(d) % 64) % 64;
+					if (head > bytes) head = bytes;
+					std::memcpy(d, s, head);
+					d += head;
+					s += head;
+					bytes -= head;
+					std::size_t body = bytes / 64 * 64;
+					for (std::size_t i = 0; i < body; i += 64) {
+#if defined(__AVX512F__)
+						_mm512_stream_si512(reinterpret_cast<__m512i*>(d + i), _mm512_loadu_si512(reinterpret_cast<const void*>(s + i)));
+#elif defined(__AVX__)
+						_mm256_stream_si256(reinterpret_cast<__m256i*>(d + i), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)));
+						_mm256_stream_si256(reinterpret_cast<__m256i*>(d + i + 32), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + 32)));
+#else
+						for (std::size_t j = 0; j < 64; j += 16)
+							_mm_stream_si128(reinterpret_cast<__m128i*>(d + i + j), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + j)));
+#endif
+					}
+					std::memcpy(d + body, s + body, bytes - body);
+					//non-temporal stores are weakly ordered, make them visible before the copy is reported done
+					_mm_sfence();
+#else
+					std::memcpy(dst, src, bytes);
+#endif
+				}
+
+				inline std::size_t threads_for(std::size_t bytes, std::size_t n_threads) {
+					if (bytes < parallel_threshold) return 1;
+					if (n_threads == 0) n_threads = parallel::default_threads();
+					std::size_t most = bytes / min_bytes_per_thread;
+					return std::max<std::size_t>(1, std::min(n_threads, most));
+				}
+
+				inline void copy_chunk(void* dst, const void* src, std::size_t bytes, bool streaming) {
+					if (streaming) stream_copy(dst, src, bytes);
+					else std::memcpy(dst, src, bytes);
+				}
+			}
+
+			//copies of at least this many bytes use non-temporal stores, by default the size of the last level cache
+			[[nodiscard]] inline std::size_t streaming_threshold() { return detail::streaming_threshold().load(std::memory_order_relaxed); }
+			inline void set_streaming_threshold(std::size_t bytes) { detail::streaming_threshold().store(bytes, std::memory_order_relaxed); }
+
+			//the ranges must not overlap, n_threads = 0 uses parallel::default_threads()
+			inline void copy_bytes(void* dst, const void* src, std::size_t bytes, std::size_t n_threads = 0) {
+				bool streaming = bytes >= streaming_threshold();
+				auto n = detail::threads_for(bytes, n_threads);
+				if (n == 1) {
+					detail::copy_chunk(dst, src, bytes, streaming);
+					return;
+				}
+				//chunks are cut at cache line boundaries of dst, so that no two threads write to the same line
+				//line k of dst starts k * 64 - misalignment bytes into the copy
+				std::size_t misalignment = reinterpret_cast<std::uintptr_t>(dst) % 64;
+				std::size_t lines = (misalignment + bytes + 63) / 64;
+				auto offset = [=](std::size_t line) { return line == 0 ? std::size_t(0) : std::min(line * 64 - misalignment, bytes); };
+				parallel::for_each_chunk(lines, n, [=](std::size_t, std::size_t begin, std::size_t end) {
+					std::size_t first = offset(begin);
+					std::size_t last = offset(end);
+					detail::copy_chunk(static_cast<char*>(dst) + first, static_cast<const char*>(src) + first, last - first, streaming);
+					});
+			}
+
+			template <class T>
+			void copy(T* dst, const T* src, std::size_t n, std::size_t n_threads = 0) {
+				static_assert(std::is_trivially_copyable<T>::value, "The copy engine only copies trivially copyable types");
+				copy_bytes(dst, src, n * sizeof(T), n_threads);
+			}
+
+			//copies height rows of width elements, rows start every dst_pitch and src_pitch elements, as cudaMemcpy2D
+			//width == 1 gives an element-wise strided copy
+			template <class T>
+			void copy_2d(T* dst, std::size_t dst_pitch, const T* src, std::size_t src_pitch, std::size_t width, std::size_t height, std::size_t n_threads = 0) {
+				static_assert(std::is_trivially_copyable<T>::value, "The copy engine only copies trivially copyable types");
+				if (dst_pitch == width && src_pitch == width) {
+					copy(dst, src, width * height, n_threads);
+					return;
+				}
+				std::size_t bytes = width * height * sizeof(T);
+				bool streaming = bytes >= streaming_threshold();
+				parallel::for_each_chunk(height, detail::threads_for(bytes, n_threads), [=](std::size_t, std::size_t begin, std::size_t end) {
+					if (width == 1) {
+						for (std::size_t r = begin; r < end; ++r) dst[r * dst_pitch] = src[r * src_pitch];
+						return;
+					}
+					for (std::size_t r = begin; r < end; ++r)
+						detail::copy_chunk(dst + r * dst_pitch, src + r * src_pitch, width * sizeof(T), streaming);
+					});
+			}
+
+			struct task {
+				void* dst;
+				const void* src;
+				std::size_t bytes;
+			};
+
+			template <class T>
+			[[nodiscard]] task make_task(T* dst, const T* src, std::size_t n) {
+				static_assert(std::is_trivially_copyable<T>::value, "The copy engine only copies trivially copyable types");
+				return { dst, src, n * sizeof(T) };
+			}
+
+			//many independent copies in one call
+			//the concatenated bytes of all tasks are split evenly over the threads, so small and large tasks balance out
+			inline void copy_batch(const std::vector<task>& tasks, std::size_t n_threads = 0) {
+				std::vector<std::size_t> offsets(tasks.size() + 1, 0);
+				for (std::size_t i = 0; i < tasks.size(); ++i) offsets[i + 1] = offsets[i] + tasks[i].bytes;
+				std::size_t bytes = offsets.back();
+				bool streaming = bytes >= streaming_threshold();
+				std::size_t lines = (bytes + 63) / 64;
+				parallel::for_each_chunk(lines, detail::threads_for(bytes, n_threads), [&](std::size_t, std::size_t begin, std::size_t end) {
+					std::size_t first = begin * 64;
+					std::size_t last = std::min(end * 64, bytes);
+					auto i = static_cast<std::size_t>(std::upper_bound(offsets.begin(), offsets.end(), first) - offsets.begin()) - 1;
+					for (; i < tasks.size() && offsets[i] < last; ++i) {
+						std::size_t b = std::max(first, offsets[i]) - offsets[i];
+						std::size_t e = std::min(last, offsets[i + 1]) - offsets[i];
+						if (e > b) detail::copy_chunk(static_cast<char*>(tasks[i].dst) + b, static_cast<const char*>(tasks[i].src) + b, e - b, streaming);
+					}
+					});
+			}
+
+			//copies src into dst starting at element shift of dst
+			//dst is taken by forwarding reference, so that views returned by value can be written to
+			template <class DstArrayT, class SrcArrayT,
+				class = std::enable_if_t<std::is_base_of<ArrayCPUBase, std::decay_t<DstArrayT>>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value>>
+			void copy(DstArrayT&& dst, const SrcArrayT& src, std::size_t shift = 0, std::size_t n_threads = 0) {
+				if (dst.size_ < (src.size_ + shift)) throw std::logic_error("copy can not be done from a larger array to a smaller one");
+				copy(dst.pointer() + shift, src.pointer(), src.size_, n_threads);
+			}
+		}
+	}
+}
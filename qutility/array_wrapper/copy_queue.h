@@ -0,0 +1,124 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "../parallel.h"
+#include "array_wrapper_cpu.h"
+#include "copy_engine.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		//asynchronous copies and transforms between CPU arrays, without the CUDA runtime
+		//a queue executes its submissions in FIFO order on one dispatcher thread, so they overlap with the caller but never with each other
+		//submissions that should run concurrently go to different queues
+		//a copy or transform is split over n_threads workers through copy_engine, so a single large copy is still multithreaded
+		//the default of one thread runs everything on the dispatcher alone, leaving the other cores to the computation
+		//the arrays must stay alive until the returned future is ready
+		class CopyQueue {
+		public:
+			//n_threads = 0 uses parallel::default_threads() for each submission
+			explicit CopyQueue(std::size_t n_threads = 1) : n_threads_(n_threads), dispatcher_([this] { run(); }) {}
+			CopyQueue(const CopyQueue&) = delete;
+			CopyQueue& operator=(const CopyQueue&) = delete;
+			//waits for all submissions before returning
+			~CopyQueue() {
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stop_ = true;
+				}
+				cv_.notify_all();
+				dispatcher_.join();
+			}
+
+			//runs f() on the dispatcher, an exception thrown by f is delivered through the future
+			template <class F>
+			std::future<void> submit(F&& f) {
+				std::packaged_task<void()> task(std::forward<F>(f));
+				auto ans = task.get_future();
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (stop_) throw std::logic_error("Submission can not be done to a stopping queue");
+					tasks_.push_back(std::move(task));
+				}
+				cv_.notify_all();
+				return ans;
+			}
+
+			//copies src into dst starting at element shift of dst
+			template <class DstArrayT, class SrcArrayT,
+				class = std::enable_if_t<std::is_base_of<ArrayCPUBase, std::decay_t<DstArrayT>>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value>>
+			std::future<void> copy(DstArrayT&& dst, const SrcArrayT& src, std::size_t shift = 0) {
+				if (dst.size_ < (src.size_ + shift)) throw std::logic_error("copy can not be done from a larger array to a smaller one");
+				auto d = dst.pointer() + shift;
+				auto s = src.pointer();
+				auto n = src.size_;
+				return submit([d, s, n, n_threads = n_threads_] { copy_engine::copy(d, s, n, n_threads); });
+			}
+
+			//dst[i] = op(src[i]) for all elements of src
+			template <class DstArrayT, class SrcArrayT, class Op,
+				class = std::enable_if_t<std::is_base_of<ArrayCPUBase, std::decay_t<DstArrayT>>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value>>
+			std::future<void> transform(DstArrayT&& dst, const SrcArrayT& src, Op op) {
+				if (dst.size_ < src.size_) throw std::logic_error("transform can not be done from a larger array to a smaller one");
+				auto d = dst.pointer();
+				auto s = src.pointer();
+				auto n = src.size_;
+				return submit([d, s, n, op, n_threads = n_threads_] {
+					parallel::for_each_chunk(n, copy_engine::detail::threads_for(n * sizeof(*d), n_threads), [d, s, &op](std::size_t, std::size_t begin, std::size_t end) {
+						for (std::size_t i = begin; i < end; ++i) d[i] = op(s[i]);
+						});
+					});
+			}
+
+			[[nodiscard]] std::size_t n_threads() const noexcept { return n_threads_; }
+
+			//blocks until everything submitted so far is done
+			void wait() { submit([] {}).wait(); }
+
+		private:
+			void run() {
+				for (;;) {
+					std::packaged_task<void()> task;
+					{
+						std::unique_lock<std::mutex> lock(mutex_);
+						cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+						if (tasks_.empty()) return;
+						task = std::move(tasks_.front());
+						tasks_.pop_front();
+					}
+					task();
+				}
+			}
+
+			const std::size_t n_threads_;
+			std::mutex mutex_;
+			std::condition_variable cv_;
+			std::deque<std::packaged_task<void()>> tasks_;
+			bool stop_ = false;
+			std::thread dispatcher_;
+		};
+
+		//CPU counterpart of array_copy_async in array_wrapper_gpu.h, ordered with the other submissions to queue
+		template<
+			class DstArrayT, class SrcArrayT,
+			class = std::enable_if_t<
+			std::is_base_of<ArrayCPUBase, std::decay_t<DstArrayT>>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value &&
+			std::is_same<
+			std::decay_t<std::remove_pointer_t< decltype(std::declval<SrcArrayT>().pointer())>>,
+			std::decay_t<std::remove_pointer_t< decltype(std::declval<DstArrayT>().pointer())>>
+			>::value
+			>
+		>
+			std::future<void> array_copy_async(DstArrayT&& dst, const SrcArrayT& src, size_t shift, CopyQueue& queue) {
+			return queue.copy(std::forward<DstArrayT>(dst), src, shift);
+		}
+	}
+}
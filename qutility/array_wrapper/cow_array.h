@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "boost/align.hpp"
+#include "array_wrapper_cpu.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		//copy-on-write array, copies share one ArrayCPU buffer until one of them is accessed through a non-const member
+		//the reference count is atomic, so copies may be handed to other threads
+		//note that operator[] and pointer() on a non-const object count as a mutable access, read through a const reference (or read()) to keep sharing
+		//only the conversion to const T* is implicit, so that legacy read-only call sites do not copy, writers call write() explicitly
+		template<class T, class Allocator, size_t A>
+		class CowArray : ArrayCPUBase {
+		public:
+			using array_type = ArrayCPU<T, Allocator, A>;
+
+			CowArray() = delete;
+			CowArray(std::size_t S) : size_(S), buffer_(std::make_shared<array_type>(S)) {	}
+			CowArray(const T& val, std::size_t S) : size_(S), buffer_(std::make_shared<array_type>(val, S)) {	}
+			CowArray(std::size_t S, uninitialized_t) : size_(S), buffer_(std::make_shared<array_type>(S, uninitialized)) {	}
+			template<typename OtherT, typename OtherAlloc>
+			CowArray(const std::vector<OtherT, OtherAlloc>& v, std::size_t S) : size_(S), buffer_(std::make_shared<array_type>(v, S)) {	}
+			CowArray(const array_type& arr) : size_(arr.size_), buffer_(std::make_shared<array_type>(arr)) {	}
+			//takes over the buffer of arr without copying
+			CowArray(array_type&& arr) : size_(arr.size_), buffer_(std::make_shared<array_type>(std::move(arr))) {	}
+			CowArray(const CowArray& rhs) = default;
+			CowArray(CowArray&& rhs) = default;
+			//assignments share the buffer of rhs, sizes must match
+			CowArray& operator=(const CowArray& rhs) {
+				if (size_ != rhs.size_) throw std::logic_error("Assignment can not be done between two arrays of different sizes");
+				buffer_ = rhs.buffer_;
+				return *this;
+			}
+			CowArray& operator=(CowArray&& rhs) {
+				if (size_ != rhs.size_) throw std::logic_error("Assignment can not be done between two arrays of different sizes");
+				buffer_ = std::move(rhs.buffer_);
+				return *this;
+			}
+			//a shared buffer is replaced by a fresh one without copying, since every element is overwritten
+			template <class E, class = std::enable_if_t<std::is_base_of<ExpressionBase, E>::value>>
+			CowArray& operator=(const E& e) {
+				if (shared()) {
+					auto old = std::move(buffer_); //e may refer to the old buffer, keep it alive until evaluated
+					buffer_ = std::make_shared<array_type>(size_, uninitialized);
+					assign(*buffer_, e);
+				}
+				else assign(write(), e);
+				return *this;
+			}
+
+			operator const T* () const { return pointer(); }
+			const T* operator+(size_t shift) const { return pointer() + shift; }
+
+			const std::size_t size_;
+			constexpr static std::size_t Alignment = A;
+
+			inline const T* pointer() const { return buffer_->pointer(); }
+			inline T* pointer() { return write().pointer(); }
+			inline const T& operator[](size_t pos) const { return (*buffer_)[pos]; }
+			inline T& operator[](size_t pos) { return write()[pos]; }
+
+			//the underlying array, for the functions taking ArrayCPU
+			[[nodiscard]] const array_type& read() const { return *buffer_; }
+			//the underlying array after making the buffer exclusive
+			array_type& write() {
+				if (buffer_.use_count() > 1) buffer_ = std::make_shared<array_type>(*buffer_);
+				else std::atomic_thread_fence(std::memory_order_acquire); //reads of former co-owners happen before our writes
+				return *buffer_;
+			}
+
+			[[nodiscard]] bool shared() const noexcept { return buffer_.use_count() > 1; }
+			[[nodiscard]] long use_count() const noexcept { return buffer_.use_count(); }
+
+		private:
+			std::shared_ptr<array_type> buffer_;
+		};
+
+		template <class T, std::size_t A = 64>
+		using CowArrayDDR = CowArray<T, boost::alignment::aligned_allocator<T, A>, A>;
+	}
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace qutility {
@@ -8,15 +12,59 @@ namespace qutility {
 			template<typename T, typename Alloc>
 			std::vector<T, Alloc> duplicate(const std::vector<T, Alloc>& v, size_t size) {
 				auto v_dup = v;
-				v_dup.resize(size);
+				v_dup.resize(size, T());
 				return v_dup;
 			}
 
+			//converts the leading part of v directly, only the padding is value-initialized
 			template<typename T1, typename Alloc1, typename T2, typename Alloc2>
 			std::vector<T1, Alloc1> duplicate(const std::vector<T2, Alloc2>& v, size_t size) {
-				auto v_dup = v;
-				v_dup.resize(size);
-				return std::vector<T1, Alloc1>(v_dup.cbegin(), v_dup.cend());
+				std::vector<T1, Alloc1> v_dup;
+				v_dup.reserve(size);
+				v_dup.assign(v.cbegin(), v.cbegin() + (size < v.size() ? size : v.size()));
+				v_dup.resize(size, T1(T2()));
+				return v_dup;
+			}
+
+			template<typename T, typename Alloc>
+			std::vector<T, Alloc>&& adopt(std::vector<T, Alloc>&& v, size_t size) {
+				if (v.size() != size) v.resize(size, T());
+				return std::move(v);
+			}
+
+			//allocator adaptor whose construct() without arguments default-initializes instead of value-initializing
+			//thus std::vector<T, default_init_allocator<Alloc>>(n) leaves trivially constructible elements untouched
+			template <typename Alloc>
+			class default_init_allocator : public Alloc {
+				using traits = std::allocator_traits<Alloc>;
+			public:
+				template <typename U>
+				struct rebind {
+					using other = default_init_allocator<typename traits::template rebind_alloc<U>>;
+				};
+
+				using Alloc::Alloc;
+				default_init_allocator() = default;
+				default_init_allocator(const Alloc& alloc) noexcept : Alloc(alloc) {}
+
+				template <typename U>
+				void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+					::new(static_cast<void*>(p)) U;
+				}
+				template <typename U, typename... Args>
+				void construct(U* p, Args&&... args) {
+					traits::construct(static_cast<Alloc&>(*this), p, std::forward<Args>(args)...);
+				}
+			};
+
+			template <typename Alloc1, typename Alloc2>
+			bool operator==(const default_init_allocator<Alloc1>& lhs, const default_init_allocator<Alloc2>& rhs) {
+				return static_cast<const Alloc1&>(lhs) == static_cast<const Alloc2&>(rhs);
+			}
+
+			template <typename Alloc1, typename Alloc2>
+			bool operator!=(const default_init_allocator<Alloc1>& lhs, const default_init_allocator<Alloc2>& rhs) {
+				return !(lhs == rhs);
 			}
 		}
 	}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include "../parallel.h"
+#include "array_wrapper_cpu.h"
+
+//asserts that a loop carries no dependency between iterations
+//for element-wise expressions this holds unless the output partially overlaps an input, see expression::assign_impl
+#if defined(__clang__)
+#define QUTILITY_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define QUTILITY_IVDEP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+#define QUTILITY_IVDEP __pragma(loop(ivdep))
+#else
+#define QUTILITY_IVDEP
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace expression {
+			//an expression only stores pointers to the arrays it refers to
+			//so it must be evaluated before any of these arrays is destroyed, typically within the same statement
+
+			template <class E>
+			struct is_expression : std::is_base_of<ExpressionBase, std::decay_t<E>> {};
+
+			template <class E>
+			struct is_array : std::is_base_of<ArrayCPUBase, std::decay_t<E>> {};
+
+			template <class T>
+			struct is_scalar : std::is_arithmetic<T> {};
+			template <class T>
+			struct is_scalar<std::complex<T>> : std::true_type {};
+
+			//sizes of scalar operands
+			constexpr std::size_t any_size = static_cast<std::size_t>(-1);
+
+			template <class T>
+			class Terminal : public ExpressionBase {
+			public:
+				using value_type = T;
+				Terminal(const T* pointer, std::size_t size) : pointer_(pointer), size_(size) {}
+				inline const T& operator[](std::size_t pos) const { return pointer_[pos]; }
+				[[nodiscard]] std::size_t size() const noexcept { return size_; }
+				//true if the operand shares memory with [out, out + n) without coinciding with it element by element
+				template <class U>
+				[[nodiscard]] bool overlaps(const U* out, std::size_t n) const noexcept {
+					auto begin = reinterpret_cast<std::uintptr_t>(pointer_), end = begin + size_ * sizeof(T);
+					auto out_begin = reinterpret_cast<std::uintptr_t>(out), out_end = out_begin + n * sizeof(U);
+					return begin < out_end && out_begin < end && !(begin == out_begin && sizeof(T) == sizeof(U));
+				}
+			private:
+				const T* pointer_;
+				std::size_t size_;
+			};
+
+			template <class T>
+			class Scalar : public ExpressionBase {
+			public:
+				using value_type = T;
+				Scalar(const T& val) : val_(val) {}
+				inline const T& operator[](std::size_t) const { return val_; }
+				[[nodiscard]] constexpr std::size_t size() const noexcept { return any_size; }
+				template <class U>
+				[[nodiscard]] constexpr bool overlaps(const U*, std::size_t) const noexcept { return false; }
+			private:
+				T val_;
+			};
+
+			template <class Op, class E>
+			class Unary : public ExpressionBase {
+			public:
+				using value_type = std::decay_t<decltype(Op::apply(std::declval<typename E::value_type>()))>;
+				Unary(const E& e) : e_(e) {}
+				inline value_type operator[](std::size_t pos) const { return Op::apply(e_[pos]); }
+				[[nodiscard]] std::size_t size() const noexcept { return e_.size(); }
+				template <class U>
+				[[nodiscard]] bool overlaps(const U* out, std::size_t n) const noexcept { return e_.overlaps(out, n); }
+			private:
+				E e_;
+			};
+
+			template <class Op, class L, class R>
+			class Binary : public ExpressionBase {
+			public:
+				using value_type = std::decay_t<decltype(Op::apply(std::declval<typename L::value_type>(), std::declval<typename R::value_type>()))>;
+				Binary(const L& l, const R& r) : l_(l), r_(r) {
+					if (l_.size() != any_size && r_.size() != any_size && l_.size() != r_.size())
+						throw std::logic_error("Expression can not be built from two arrays of different sizes");
+				}
+				inline value_type operator[](std::size_t pos) const { return Op::apply(l_[pos], r_[pos]); }
+				[[nodiscard]] std::size_t size() const noexcept { return l_.size() != any_size ? l_.size() : r_.size(); }
+				template <class U>
+				[[nodiscard]] bool overlaps(const U* out, std::size_t n) const noexcept { return l_.overlaps(out, n) || r_.overlaps(out, n); }
+			private:
+				L l_;
+				R r_;
+			};
+
+			namespace op {
+				struct plus { template <class L, class R> static auto apply(const L& l, const R& r) { return l + r; } };
+				struct minus { template <class L, class R> static auto apply(const L& l, const R& r) { return l - r; } };
+				struct multiplies { template <class L, class R> static auto apply(const L& l, const R& r) { return l * r; } };
+				struct divides { template <class L, class R> static auto apply(const L& l, const R& r) { return l / r; } };
+				struct negate { template <class E> static auto apply(const E& e) { return -e; } };
+				struct exp { template <class E> static auto apply(const E& e) { using std::exp; return exp(e); } };
+				struct sqrt { template <class E> static auto apply(const E& e) { using std::sqrt; return sqrt(e); } };
+				struct abs { template <class E> static auto apply(const E& e) { using std::abs; return abs(e); } };
+			}
+
+			//turns an array, scalar or expression into an expression operand
+			template <class E>
+			auto wrap(const E& e) {
+				if constexpr (is_expression<E>::value) return e;
+				else if constexpr (is_array<E>::value) {
+					using T = std::remove_pointer_t<decltype(e.pointer())>;
+					return Terminal<std::remove_const_t<T>>(e.pointer(), e.size_);
+				}
+				else return Scalar<E>(e);
+			}
+
+			//starts an expression from an array explicitly, needed for a + 1.0 since ArrayCPU::operator+(size_t) is the pointer shift
+			template <class E>
+			auto lazy(const E& e) { return wrap(e); }
+
+			template <class E, class = std::enable_if_t<is_expression<E>::value || is_array<E>::value>>
+			auto exp(const E& e) { return Unary<op::exp, decltype(wrap(e))>(wrap(e)); }
+
+			template <class E, class = std::enable_if_t<is_expression<E>::value || is_array<E>::value>>
+			auto sqrt(const E& e) { return Unary<op::sqrt, decltype(wrap(e))>(wrap(e)); }
+
+			template <class E, class = std::enable_if_t<is_expression<E>::value || is_array<E>::value>>
+			auto abs(const E& e) { return Unary<op::abs, decltype(wrap(e))>(wrap(e)); }
+
+			template <class Op, class L, class R>
+			auto make_binary(const L& l, const R& r) {
+				return Binary<Op, decltype(wrap(l)), decltype(wrap(r))>(wrap(l), wrap(r));
+			}
+
+			template <class E>
+			constexpr bool is_operand = is_expression<E>::value || is_array<E>::value || is_scalar<E>::value;
+
+			//+ and - need an expression on one side to stay clear of the pointer arithmetic of ArrayCPU
+			//a - b of two arrays remains the pointer difference, lazy(a) - b is the element-wise one
+			template <class L, class R>
+			constexpr bool additive = is_operand<L> && is_operand<R> && (is_expression<L>::value || is_expression<R>::value);
+
+			template <class L, class R>
+			constexpr bool multiplicative = is_operand<L> && is_operand<R>
+				&& (is_expression<L>::value || is_expression<R>::value || is_array<L>::value || is_array<R>::value);
+		}
+
+		template <class L, class R, class = std::enable_if_t<expression::additive<L, R>>>
+		auto operator+(const L& l, const R& r) { return expression::make_binary<expression::op::plus>(l, r); }
+
+		template <class L, class R, class = std::enable_if_t<expression::additive<L, R>>>
+		auto operator-(const L& l, const R& r) { return expression::make_binary<expression::op::minus>(l, r); }
+
+		template <class L, class R, class = std::enable_if_t<expression::multiplicative<L, R>>>
+		auto operator*(const L& l, const R& r) { return expression::make_binary<expression::op::multiplies>(l, r); }
+
+		template <class L, class R, class = std::enable_if_t<expression::multiplicative<L, R>>>
+		auto operator/(const L& l, const R& r) { return expression::make_binary<expression::op::divides>(l, r); }
+
+		template <class E, class = std::enable_if_t<expression::is_expression<E>::value || expression::is_array<E>::value>>
+		auto operator-(const E& e) { return expression::Unary<expression::op::negate, decltype(expression::wrap(e))>(expression::wrap(e)); }
+
+		//evaluates e into dst in one pass, split over n_threads with parallel::for_each_chunk
+		//dst may appear in e since every element only depends on elements at the same position
+		//if dst partially overlaps an operand (e.g. views shifted against each other) the loop keeps its dependency and runs on one thread
+		//sizes follow ArrayCPU::operator=: a larger expression throws, a smaller one is written to the leading elements of dst
+		namespace expression {
+			template <class T, class E>
+			void assign_impl(T* out, std::size_t size, const E& e, std::size_t n_threads) {
+				if (e.size() != any_size) {
+					if (e.size() > size)
+						throw std::logic_error("Assignment can not be done from a larger expression to a smaller array");
+					size = e.size();
+				}
+				if (e.overlaps(out, size)) {
+					for (std::size_t i = 0; i < size; ++i) out[i] = e[i];
+					return;
+				}
+				parallel::for_each_chunk(size, n_threads, [out, &e](std::size_t, std::size_t begin, std::size_t end) {
+					QUTILITY_IVDEP
+					for (std::size_t i = begin; i < end; ++i) out[i] = e[i];
+					});
+			}
+		}
+
+		template <class T, class Alloc, std::size_t A, class E, class = std::enable_if_t<std::is_base_of<ExpressionBase, E>::value>>
+		void assign(ArrayCPU<T, Alloc, A>& dst, const E& e, std::size_t n_threads = 1) {
+			expression::assign_impl(dst.pointer(), dst.size_, e, n_threads);
+		}
+
+		template <class T, std::size_t A, class E, class = std::enable_if_t<std::is_base_of<ExpressionBase, E>::value>>
+		void assign(const ArrayCPUView<T, A>& dst, const E& e, std::size_t n_threads = 1) {
+			expression::assign_impl(dst.pointer(), dst.size_, e, n_threads);
+		}
+	}
+}
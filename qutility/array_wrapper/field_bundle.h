@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "boost/align.hpp"
+#include "../parallel.h"
+#include "array_wrapper_cpu.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace field_bundle {
+			//pad chosen by the bundle: one alignment unit, only if the field stride would otherwise be a multiple of critical_stride
+			constexpr std::size_t auto_pad = static_cast<std::size_t>(-1);
+			//extra elements after every field, a distinct type so that it does not compete with the fill value in the constructors
+			struct padding { std::size_t elements = auto_pad; };
+			//fields whose starts differ by a multiple of this many bytes map to the same L1/L2 cache sets
+			constexpr std::size_t critical_stride = 4096;
+
+			//distance in elements between the starts of two neighbouring fields
+			//every field starts at an A-byte boundary, pad is given in elements
+			template <class T, std::size_t A>
+			constexpr std::size_t stride(std::size_t S, std::size_t pad) {
+				auto round_up = [](std::size_t bytes) { return (bytes + A - 1) / A * A; };
+				std::size_t bytes = round_up(S * sizeof(T));
+				if (pad == auto_pad) {
+					if (bytes % critical_stride == 0) bytes += A;
+				}
+				else bytes = round_up((S + pad) * sizeof(T));
+				return bytes / sizeof(T);
+			}
+		}
+
+		//n_fields fields of size S in a single aligned allocation
+		//field(i) returns an ArrayCPUView, the bundle itself behaves as one ArrayCPU of all fields including the pads
+		//hence array_copy and assignment of whole bundles are a single transfer
+		template<class T, class Allocator, size_t A>
+		class FieldBundle : ArrayCPUBase {
+			static_assert(A % sizeof(T) == 0, "The alignment must be a multiple of the size of the element");
+		public:
+			using allocator_type = detail::default_init_allocator<Allocator>;
+			using storage_type = std::vector<T, allocator_type>;
+			using view_type = ArrayCPUView<T, A>;
+			using const_view_type = ArrayCPUView<const T, A>;
+
+			FieldBundle() = delete;
+			FieldBundle(std::size_t n_fields, std::size_t S, field_bundle::padding pad = {})
+				: FieldBundle(T(), n_fields, S, pad) {	}
+			FieldBundle(const T& val, std::size_t n_fields, std::size_t S, field_bundle::padding pad = {})
+				: n_fields_(n_fields), field_size_(S), stride_(field_bundle::stride<T, A>(S, pad.elements)), size_(n_fields_* stride_),
+				data_(size_, val), pointer_(&(data_.at(0))) {	}
+			FieldBundle(std::size_t n_fields, std::size_t S, uninitialized_t, field_bundle::padding pad = {})
+				: n_fields_(n_fields), field_size_(S), stride_(field_bundle::stride<T, A>(S, pad.elements)), size_(n_fields_* stride_),
+				data_(size_), pointer_(&(data_.at(0))) {	}
+			FieldBundle(const T& val, std::size_t n_fields, std::size_t S, first_touch_t ft, field_bundle::padding pad = {})
+				: FieldBundle(n_fields, S, uninitialized, pad) {
+				fill(val, ft.threads_for(size_ * sizeof(T)));
+			}
+			FieldBundle(const FieldBundle& rhs)
+				: n_fields_(rhs.n_fields_), field_size_(rhs.field_size_), stride_(rhs.stride_), size_(rhs.size_),
+				data_(rhs.data_), pointer_(&(data_.at(0))) {	}
+			//the buffer of rhs is stolen, rhs is left without storage and assignments to or from it throw
+			FieldBundle(FieldBundle&& rhs)
+				: n_fields_(rhs.n_fields_), field_size_(rhs.field_size_), stride_(rhs.stride_), size_(rhs.size_),
+				data_(std::move(rhs.data_)), pointer_(&(data_.at(0))) {
+				rhs.pointer_ = nullptr;
+			}
+			//bulk copy of all fields in one memcpy, the layouts must agree
+			FieldBundle& operator=(const FieldBundle& rhs) {
+				check_storage(rhs);
+				if (n_fields_ != rhs.n_fields_ || field_size_ != rhs.field_size_ || stride_ != rhs.stride_)
+					throw std::logic_error("Assignment can not be done between two bundles of different layouts");
+				std::memcpy(pointer_, rhs.pointer(), sizeof(T) * size_);
+				return *this;
+			}
+			FieldBundle& operator=(FieldBundle&& rhs) {
+				check_storage(rhs);
+				if (n_fields_ != rhs.n_fields_ || field_size_ != rhs.field_size_ || stride_ != rhs.stride_)
+					throw std::logic_error("Assignment can not be done between two bundles of different layouts");
+				data_.swap(rhs.data_);
+				std::swap(pointer_, rhs.pointer_);
+				return *this;
+			}
+
+			inline view_type field(std::size_t i) { return view_type(pointer_ + i * stride_, field_size_); }
+			inline const_view_type field(std::size_t i) const { return const_view_type(pointer_ + i * stride_, field_size_); }
+			inline view_type operator[](std::size_t i) { return field(i); }
+			inline const_view_type operator[](std::size_t i) const { return field(i); }
+
+			//fills all fields, pads included, split over n_threads
+			void fill(const T& val, std::size_t n_threads = 1) {
+				T* out = pointer_;
+				parallel::for_each_chunk(size_, n_threads, [out, &val](std::size_t, std::size_t begin, std::size_t end) {
+					std::fill(out + begin, out + end, val);
+					});
+			}
+			void zero(std::size_t n_threads = 1) { fill(T(), n_threads); }
+
+			const std::size_t n_fields_;
+			const std::size_t field_size_;
+			const std::size_t stride_;
+			const std::size_t size_; //all elements of the allocation, n_fields_ * stride_
+			constexpr static std::size_t Alignment = A;
+
+			inline const T* pointer() const { return pointer_; }
+			inline T* pointer() { return pointer_; }
+
+		protected:
+			void check_storage(const FieldBundle& rhs) const {
+				if (pointer_ == nullptr || rhs.pointer_ == nullptr) throw std::logic_error("Assignment can not be done with a moved-from bundle");
+			}
+
+			storage_type data_;
+			T* pointer_;
+		};
+
+		template <class T, std::size_t A = 64>
+		using DFieldBundleDDR = FieldBundle<T, boost::alignment::aligned_allocator<T, A>, A>;
+
+		template <class T, std::size_t A = 64>
+		using DFieldBundleHBW = FieldBundle<T, hbw::allocator<T, A>, A>;
+	}
+}
@@ -2,18 +2,91 @@
 
 #include <immintrin.h>
 #include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <mutex>
 
+//values as in hbwmalloc.h of memkind
+typedef enum {
+	HBW_POLICY_BIND = 1,
+	HBW_POLICY_PREFERRED = 2,
+	HBW_POLICY_INTERLEAVE = 3,
+	HBW_POLICY_BIND_ALL = 4
+} hbw_policy_t;
+
+#define HBW_TOUCH_PAGES (1 << 0)
+
+//no high bandwidth memory unless HBW_DEBUG_AVAILABLE is set, in which case ordinary memory pretends to be one
+//HBW_DEBUG_LIMIT then caps the bytes in use, so that an exhausted high bandwidth memory can be simulated
 inline int hbw_check_available()
 {
-	return ENODEV;
+	return std::getenv("HBW_DEBUG_AVAILABLE") ? 0 : ENODEV;
+}
+
+namespace hbw_debug {
+	struct state {
+		std::mutex mutex;
+		std::map<const char*, size_t> blocks;
+		size_t used = 0;
+		size_t limit = limit_from_env();
+		bool policy_set = false;
+
+		static size_t limit_from_env() {
+			const char* s = std::getenv("HBW_DEBUG_LIMIT");
+			return s ? std::strtoull(s, nullptr, 10) : size_t(-1);
+		}
+	};
+	inline state& get_state() {
+		static state* s = new state();
+		return *s;
+	}
+}
+
+//as in memkind, the policy can only be set once
+inline int hbw_set_policy(hbw_policy_t)
+{
+	auto& s = hbw_debug::get_state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if (s.policy_set) return EPERM;
+	s.policy_set = true;
+	return 0;
 }
 
 inline int hbw_posix_memalign(void **memptr, size_t alignment, size_t size)
 {
+	auto& s = hbw_debug::get_state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if (size > s.limit - s.used) return ENOMEM;
 	*memptr = _mm_malloc(size, alignment);
+	if (!*memptr) return ENOMEM;
+	s.blocks[static_cast<const char*>(*memptr)] = size;
+	s.used += size;
 	return 0;
 }
 
+//blocks handed out by the debug replacement count as high bandwidth memory, everything else as DDR
+inline int hbw_verify_memory_region(void* addr, size_t size, int)
+{
+	if (!addr || size == 0) return EINVAL;
+	auto& s = hbw_debug::get_state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	auto p = static_cast<const char*>(addr);
+	auto it = s.blocks.upper_bound(p);
+	if (it == s.blocks.begin()) return -1;
+	--it;
+	return p + size <= it->first + it->second ? 0 : -1;
+}
+
 inline void hbw_free(void * memptr) {
+	if (!memptr) return;
+	auto& s = hbw_debug::get_state();
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		auto it = s.blocks.find(static_cast<const char*>(memptr));
+		if (it != s.blocks.end()) {
+			s.used -= it->second;
+			s.blocks.erase(it);
+		}
+	}
 	_mm_free(memptr);
 }
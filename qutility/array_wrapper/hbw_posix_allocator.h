@@ -4,6 +4,7 @@
 //! Note that this actually will not compile successfully unless a memkind for Windows is present
 //! My originally simple replacement for these functions are used for debug purpose if HBW_DEGUG_WIN is defined
 //! Yicheng Qiang 20200602
+//! Runtime policies (hbw::set_policy) with a fallback to aligned DDR were added on top, see the hbw::detail namespace below
 
 // SPDX-License-Identifier: BSD-2-Clause
 /* Copyright (C) 2014 - 2020 Intel Corporation. */
@@ -25,7 +26,13 @@
 #endif // HBW_DEGUG_WIN
 
 #include <stddef.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
 #include <new>
+#include <unordered_set>
+#include "boost/align.hpp"
 /*
  * Header file for the C++ allocator compatible with the C++ standard library allocator concepts.
  * More details in hbwallocator(3) man page.
@@ -36,6 +43,138 @@
  */
 namespace hbw
 {
+	//bind: high bandwidth memory only, bad_alloc if it is missing or exhausted
+	//preferred: high bandwidth memory if possible, aligned DDR otherwise
+	//interleave: pages interleaved over the high bandwidth nodes if possible, aligned DDR otherwise
+	enum class policy { bind, preferred, interleave };
+
+	//unknown if the placement can not be determined, e.g. for pages not touched yet or without memkind
+	enum class location { hbw, ddr, unknown };
+
+	namespace detail {
+		//memkind only accepts the policy before the first allocation, so it is committed then and fixed afterwards
+		//memkind is always asked to bind, so that a failed allocation is seen here and the fallback is known
+		//if memkind refuses the policy, e.g. because something else allocated or set it first, its own policy stays in effect
+		//and its blocks may lie in DDR, which is neither seen nor counted here, location_of() can tell afterwards
+		//the allocation path takes no lock once the policy is committed, only the DDR fallback records its blocks
+		struct state {
+			std::mutex mutex;
+			policy selected = policy_from_env();
+			std::atomic<bool> committed{ false };
+			bool policy_applied = false; //written before committed is set, constant afterwards
+			std::unordered_set<void*> ddr; //blocks that fell back to aligned DDR
+			std::atomic<size_t> fallbacks{ 0 };
+
+			//QUTILITY_HBW_POLICY=bind|preferred|interleave, preferred if unset
+			static policy policy_from_env() {
+				const char* s = std::getenv("QUTILITY_HBW_POLICY");
+				if (s && std::strcmp(s, "bind") == 0) return policy::bind;
+				if (s && std::strcmp(s, "interleave") == 0) return policy::interleave;
+				return policy::preferred;
+			}
+		};
+
+		//leaked on purpose, so that arrays with static storage duration can still be freed at exit
+		inline state& get_state() {
+			static state* s = new state();
+			return *s;
+		}
+	}
+
+	//true if the node has high bandwidth memory that memkind can use
+	inline bool available()
+	{
+		static const bool ans = hbw_check_available() == 0;
+		return ans;
+	}
+
+	//returns false if an allocation already happened with a different policy
+	inline bool set_policy(policy p)
+	{
+		auto& s = detail::get_state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.committed) return s.selected == p;
+		s.selected = p;
+		return true;
+	}
+
+	inline policy get_policy()
+	{
+		auto& s = detail::get_state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		return s.selected;
+	}
+
+	//true if memkind accepted the policy at the first allocation
+	inline bool policy_applied()
+	{
+		auto& s = detail::get_state();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		return s.committed.load() && s.policy_applied;
+	}
+
+	//where the page holding p actually resides
+	//blocks of the DDR fallback are known by their start, everything else is asked from memkind without touching the page
+	//so call it after the array was constructed, pages that were never touched give unknown
+	inline location location_of(const void* p)
+	{
+		auto& s = detail::get_state();
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			if (s.ddr.count(const_cast<void*>(p))) return location::ddr;
+		}
+		if (!available() || !p) return location::unknown;
+		switch (hbw_verify_memory_region(const_cast<void*>(p), 1, 0)) {
+		case 0: return location::hbw;
+		case -1: return location::ddr;
+		default: return location::unknown;
+		}
+	}
+
+	//number of allocations that fell back to aligned DDR so far
+	inline size_t fallback_count()
+	{
+		return detail::get_state().fallbacks.load();
+	}
+
+	namespace detail {
+		inline void* allocate(size_t alignment, size_t bytes)
+		{
+			if (alignment < sizeof(void*)) alignment = sizeof(void*);
+			auto& s = get_state();
+			if (!s.committed.load(std::memory_order_acquire)) {
+				std::lock_guard<std::mutex> lock(s.mutex);
+				if (!s.committed.load(std::memory_order_relaxed)) {
+					s.policy_applied = available() && hbw_set_policy(s.selected == policy::interleave ? HBW_POLICY_INTERLEAVE : HBW_POLICY_BIND) == 0;
+					s.committed.store(true, std::memory_order_release);
+				}
+			}
+			policy p = s.selected;
+			//the pages are not verified here, that would fault them in on this thread and defeat first_touch
+			void* result = nullptr;
+			if (available() && hbw_posix_memalign(&result, alignment, bytes) == 0 && result) return result;
+			if (p == policy::bind) throw std::bad_alloc();
+			result = boost::alignment::aligned_alloc(alignment, bytes);
+			if (!result) throw std::bad_alloc();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			s.ddr.insert(result);
+			++s.fallbacks;
+			return result;
+		}
+
+		inline void deallocate(void* p)
+		{
+			auto& s = get_state();
+			if (s.fallbacks.load(std::memory_order_acquire) != 0) {
+				std::lock_guard<std::mutex> lock(s.mutex);
+				if (s.ddr.erase(p)) {
+					boost::alignment::aligned_free(p);
+					return;
+				}
+			}
+			hbw_free(p);
+		}
+	}
 
 	template <class T, size_t Alignment>
 	class allocator
@@ -79,6 +218,7 @@ namespace hbw
 
 		/*
 		 *  Allocates n*sizeof(T) bytes of high bandwidth memory using hbw_posix_memalign() instead of hbw_malloc(). //Yicheng Qiang 20200602
+		 *  Falls back to aligned DDR according to hbw::get_policy().
 		 *  Throws std::bad_alloc when cannot allocate memory.
 		 */
 		pointer allocate(size_type n, const void* = 0)
@@ -86,20 +226,15 @@ namespace hbw
 			if (n > this->max_size()) {
 				throw std::bad_alloc();
 			}
-			pointer result;
-			hbw_posix_memalign((void**)(&result), Alignment, n * sizeof(T));
-			if (!result) {
-				throw std::bad_alloc();
-			}
-			return result;
+			return static_cast<pointer>(detail::allocate(Alignment, n * sizeof(T)));
 		}
 
 		/*
-		 *  Deallocates memory associated with pointer returned by allocate() using hbw_free().
+		 *  Deallocates memory associated with pointer returned by allocate() using hbw_free(), or aligned_free() after a fallback.
 		 */
 		void deallocate(pointer p, size_type n)
 		{
-			hbw_free(static_cast<void*>(p));
+			detail::deallocate(static_cast<void*>(p));
 		}
 
 		size_type max_size() const throw()
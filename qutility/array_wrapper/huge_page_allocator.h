@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <boost/predef.h>
+#include "boost/align.hpp"
+#include "array_wrapper_cpu.h"
+
+#if BOOST_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace huge_page {
+			//how a block obtained from HugePageAllocator is backed
+			//hugetlb: explicit huge pages from the hugetlbfs pool (MAP_HUGETLB)
+			//transparent: anonymous mapping advised with MADV_HUGEPAGE, the kernel may still back parts of it with small pages
+			//regular: small pages, either because the request was small or because both attempts above failed
+			enum class backing { regular, transparent, hugetlb };
+
+			//automatic: try hugetlb, then transparent huge pages
+			enum class mode { automatic, transparent, hugetlb };
+
+			inline const char* to_string(backing b) noexcept {
+				switch (b) {
+				case backing::hugetlb: return "hugetlb";
+				case backing::transparent: return "transparent";
+				default: return "regular";
+				}
+			}
+
+			namespace detail {
+				//default huge page size as reported by /proc/meminfo, 2 MiB if unknown
+				inline std::size_t read_huge_page_size() {
+					std::ifstream meminfo("/proc/meminfo");
+					std::string key;
+					std::size_t value;
+					while (meminfo >> key) {
+						if (key == "Hugepagesize:" && (meminfo >> value)) return value * 1024;
+						std::getline(meminfo, key);
+					}
+					return std::size_t(2) << 20;
+				}
+
+				class Registry {
+				public:
+					void insert(const void* p, backing b) {
+						std::lock_guard<std::mutex> lock(mutex_);
+						map_[p] = b;
+					}
+					void erase(const void* p) {
+						std::lock_guard<std::mutex> lock(mutex_);
+						map_.erase(p);
+					}
+					[[nodiscard]] backing find(const void* p) const {
+						std::lock_guard<std::mutex> lock(mutex_);
+						auto it = map_.find(p);
+						return it == map_.end() ? backing::regular : it->second;
+					}
+					static Registry& instance() {
+						static Registry* registry = new Registry();
+						return *registry;
+					}
+				private:
+					mutable std::mutex mutex_;
+					std::unordered_map<const void*, backing> map_;
+				};
+			}
+
+			[[nodiscard]] inline std::size_t size() {
+				static const std::size_t huge_page_size = detail::read_huge_page_size();
+				return huge_page_size;
+			}
+
+			//requests smaller than this are served by boost::alignment::aligned_alloc with regular pages
+			[[nodiscard]] inline std::size_t threshold() { return size() / 2; }
+
+			//the backing obtained when the block starting at p was allocated by a HugePageAllocator
+			[[nodiscard]] inline backing backing_of(const void* p) { return detail::Registry::instance().find(p); }
+
+			//bytes of the mapping containing p that are currently backed by huge pages of any kind, read from /proc/self/smaps
+			//this confirms whether transparent huge pages were actually granted, which only happens once the pages are touched
+			[[nodiscard]] inline std::size_t resident_huge_bytes(const void* p) {
+				std::ifstream smaps("/proc/self/smaps");
+				std::string line;
+				auto addr = reinterpret_cast<std::uintptr_t>(p);
+				bool inside = false;
+				std::size_t ans = 0;
+				while (std::getline(smaps, line)) {
+					std::uintptr_t begin, end;
+					char dash;
+					std::istringstream iss(line);
+					if ((iss >> std::hex >> begin >> dash >> end) && dash == '-') {
+						if (inside) break;
+						inside = begin <= addr && addr < end;
+						continue;
+					}
+					if (!inside) continue;
+					std::istringstream field(line);
+					std::string key;
+					std::size_t kb;
+					if ((field >> key >> kb) && (key == "AnonHugePages:" || key == "Private_Hugetlb:" || key == "Shared_Hugetlb:"))
+						ans += kb * 1024;
+				}
+				return ans;
+			}
+		}
+
+		//allocator backing large blocks with huge pages, falling back to regular pages when none are available
+		//blocks of at least huge_page::threshold() bytes are mapped separately and aligned to the huge page size
+		template <class T, std::size_t Alignment, huge_page::mode Mode = huge_page::mode::automatic>
+		class HugePageAllocator {
+		public:
+			using value_type = T;
+			using size_type = std::size_t;
+			using difference_type = std::ptrdiff_t;
+
+			template <class U>
+			struct rebind {
+				using other = HugePageAllocator<U, Alignment, Mode>;
+			};
+
+			HugePageAllocator() noexcept {}
+			template <class U>
+			HugePageAllocator(const HugePageAllocator<U, Alignment, Mode>&) noexcept {}
+
+			[[nodiscard]] T* allocate(size_type n) {
+				if (n > static_cast<size_type>(-1) / sizeof(T)) throw std::bad_alloc();
+				std::size_t bytes = n * sizeof(T);
+				void* p = nullptr;
+				huge_page::backing b = huge_page::backing::regular;
+#if BOOST_OS_LINUX
+				if (bytes >= huge_page::threshold() && Alignment <= huge_page::size()) {
+					std::size_t length = mapped_length(bytes);
+					if constexpr (Mode != huge_page::mode::transparent) {
+						p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+						if (p == MAP_FAILED) p = nullptr;
+						else b = huge_page::backing::hugetlb;
+					}
+					if (!p) {
+						p = map_aligned(length);
+#ifdef MADV_HUGEPAGE
+						if (Mode != huge_page::mode::hugetlb && madvise(p, length, MADV_HUGEPAGE) == 0)
+							b = huge_page::backing::transparent;
+#endif
+					}
+					huge_page::detail::Registry::instance().insert(p, b);
+					return static_cast<T*>(p);
+				}
+#endif
+				p = boost::alignment::aligned_alloc(Alignment, bytes);
+				if (!p) throw std::bad_alloc();
+				return static_cast<T*>(p);
+			}
+
+			void deallocate(T* p, size_type n) {
+				std::size_t bytes = n * sizeof(T);
+#if BOOST_OS_LINUX
+				if (bytes >= huge_page::threshold() && Alignment <= huge_page::size()) {
+					huge_page::detail::Registry::instance().erase(p);
+					munmap(static_cast<void*>(p), mapped_length(bytes));
+					return;
+				}
+#endif
+				boost::alignment::aligned_free(static_cast<void*>(p));
+			}
+
+		private:
+			static std::size_t mapped_length(std::size_t bytes) {
+				auto hp = huge_page::size();
+				return (bytes + hp - 1) / hp * hp;
+			}
+#if BOOST_OS_LINUX
+			//anonymous mapping of length bytes starting at a huge page boundary, so that THP can back it entirely
+			static void* map_aligned(std::size_t length) {
+				auto hp = huge_page::size();
+				void* raw = mmap(nullptr, length + hp, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (raw == MAP_FAILED) throw std::bad_alloc();
+				auto begin = reinterpret_cast<std::uintptr_t>(raw);
+				auto aligned = (begin + hp - 1) / hp * hp;
+				if (aligned > begin) munmap(raw, aligned - begin);
+				munmap(reinterpret_cast<void*>(aligned + length), begin + hp - aligned);
+				return reinterpret_cast<void*>(aligned);
+			}
+#endif
+		};
+
+		template <class T, class U, std::size_t Alignment, huge_page::mode Mode>
+		bool operator==(const HugePageAllocator<T, Alignment, Mode>&, const HugePageAllocator<U, Alignment, Mode>&) {
+			return true;
+		}
+
+		template <class T, class U, std::size_t Alignment, huge_page::mode Mode>
+		bool operator!=(const HugePageAllocator<T, Alignment, Mode>&, const HugePageAllocator<U, Alignment, Mode>&) {
+			return false;
+		}
+
+		template <class T, std::size_t A = 64, huge_page::mode Mode = huge_page::mode::automatic>
+		using DArrayDDRHuge = ArrayCPU<T, HugePageAllocator<T, A, Mode>, A>;
+	}
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <type_traits>
+#include "array_wrapper_cpu.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace kernel {
+			namespace detail {
+				//thin wrappers over the widest vector registers enabled at compile time
+				//width 1 means there is no vector path for T and the kernels fall back to scalar loops
+				template <typename T>
+				struct simd {
+					constexpr static std::size_t width = 1;
+				};
+
+#if defined(__AVX512F__)
+				template <>
+				struct simd<double> {
+					using reg = __m512d;
+					constexpr static std::size_t width = 8;
+					template <bool Aligned> static reg load(const double* p) { if constexpr (Aligned) return _mm512_load_pd(p); else return _mm512_loadu_pd(p); }
+					template <bool Aligned> static void store(double* p, reg v) { if constexpr (Aligned) _mm512_store_pd(p, v); else _mm512_storeu_pd(p, v); }
+					static reg set1(double a) { return _mm512_set1_pd(a); }
+					static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+					static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+					static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+					static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+					static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+					static reg abs(reg a) { return _mm512_abs_pd(a); }
+					static reg max(reg a, reg b) { return _mm512_max_pd(a, b); }
+					static double hsum(reg a) { return _mm512_reduce_add_pd(a); }
+					static double hmax(reg a) { return _mm512_reduce_max_pd(a); }
+				};
+
+				template <>
+				struct simd<float> {
+					using reg = __m512;
+					constexpr static std::size_t width = 16;
+					template <bool Aligned> static reg load(const float* p) { if constexpr (Aligned) return _mm512_load_ps(p); else return _mm512_loadu_ps(p); }
+					template <bool Aligned> static void store(float* p, reg v) { if constexpr (Aligned) _mm512_store_ps(p, v); else _mm512_storeu_ps(p, v); }
+					static reg set1(float a) { return _mm512_set1_ps(a); }
+					static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+					static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+					static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+					static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+					static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+					static reg abs(reg a) { return _mm512_abs_ps(a); }
+					static reg max(reg a, reg b) { return _mm512_max_ps(a, b); }
+					static float hsum(reg a) { return _mm512_reduce_add_ps(a); }
+					static float hmax(reg a) { return _mm512_reduce_max_ps(a); }
+				};
+#elif defined(__AVX2__)
+				template <>
+				struct simd<double> {
+					using reg = __m256d;
+					constexpr static std::size_t width = 4;
+					template <bool Aligned> static reg load(const double* p) { if constexpr (Aligned) return _mm256_load_pd(p); else return _mm256_loadu_pd(p); }
+					template <bool Aligned> static void store(double* p, reg v) { if constexpr (Aligned) _mm256_store_pd(p, v); else _mm256_storeu_pd(p, v); }
+					static reg set1(double a) { return _mm256_set1_pd(a); }
+					static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+					static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+					static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+					static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+#if defined(__FMA__)
+					static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+#else
+					static reg fmadd(reg a, reg b, reg c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#endif
+					static reg abs(reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+					static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+					static double hsum(reg a) {
+						__m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+						return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+					}
+					static double hmax(reg a) {
+						__m128d s = _mm_max_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+						return _mm_cvtsd_f64(_mm_max_sd(s, _mm_unpackhi_pd(s, s)));
+					}
+				};
+
+				template <>
+				struct simd<float> {
+					using reg = __m256;
+					constexpr static std::size_t width = 8;
+					template <bool Aligned> static reg load(const float* p) { if constexpr (Aligned) return _mm256_load_ps(p); else return _mm256_loadu_ps(p); }
+					template <bool Aligned> static void store(float* p, reg v) { if constexpr (Aligned) _mm256_store_ps(p, v); else _mm256_storeu_ps(p, v); }
+					static reg set1(float a) { return _mm256_set1_ps(a); }
+					static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+					static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+					static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+					static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__)
+					static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+					static reg fmadd(reg a, reg b, reg c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+					static reg abs(reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+					static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+					static float hsum(reg a) {
+						__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+						s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+						return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+					}
+					static float hmax(reg a) {
+						__m128 s = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+						s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+						return _mm_cvtss_f32(_mm_max_ss(s, _mm_shuffle_ps(s, s, 1)));
+					}
+				};
+#endif
+
+				//aligned loads and stores are used if every pointer is known to be aligned to A bytes
+				template <typename T, std::size_t A>
+				constexpr bool aligned = simd<T>::width > 1 && A != 0 && A % (simd<T>::width * sizeof(T)) == 0;
+
+				//scalar arguments do not take part in deducing T
+				template <typename T>
+				using scalar_t = typename std::common_type<T>::type;
+
+				//number of leading elements handled by the vector path
+				template <typename T>
+				constexpr std::size_t vector_part(std::size_t n) { return n / simd<T>::width * simd<T>::width; }
+			}
+
+			//all kernels take raw pointers, A is the alignment in bytes guaranteed for every pointer (0 if unknown)
+			//the overloads taking arrays or views use their Alignment and operate on the whole array
+
+			//y = val
+			template <std::size_t A = 0, typename T>
+			void fill(std::size_t n, detail::scalar_t<T> val, T* y) {
+				using S = detail::simd<T>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1) {
+					auto v = S::set1(val);
+					for (; i < detail::vector_part<T>(n); i += S::width) S::template store<detail::aligned<T, A>>(y + i, v);
+				}
+				for (; i < n; ++i) y[i] = val;
+			}
+
+			//y = a * y
+			template <std::size_t A = 0, typename T>
+			void scale(std::size_t n, detail::scalar_t<T> a, T* y) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1) {
+					auto va = S::set1(a);
+					for (; i < detail::vector_part<T>(n); i += S::width) S::template store<Al>(y + i, S::mul(va, S::template load<Al>(y + i)));
+				}
+				for (; i < n; ++i) y[i] *= a;
+			}
+
+			//y = y + a * x
+			template <std::size_t A = 0, typename T>
+			void axpy(std::size_t n, detail::scalar_t<T> a, const T* x, T* y) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1) {
+					auto va = S::set1(a);
+					for (; i < detail::vector_part<T>(n); i += S::width)
+						S::template store<Al>(y + i, S::fmadd(va, S::template load<Al>(x + i), S::template load<Al>(y + i)));
+				}
+				for (; i < n; ++i) y[i] += a * x[i];
+			}
+
+			//y = a * x + b * y
+			template <std::size_t A = 0, typename T>
+			void axpby(std::size_t n, detail::scalar_t<T> a, const T* x, detail::scalar_t<T> b, T* y) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1) {
+					auto va = S::set1(a);
+					auto vb = S::set1(b);
+					for (; i < detail::vector_part<T>(n); i += S::width)
+						S::template store<Al>(y + i, S::fmadd(va, S::template load<Al>(x + i), S::mul(vb, S::template load<Al>(y + i))));
+				}
+				for (; i < n; ++i) y[i] = a * x[i] + b * y[i];
+			}
+
+			//z = x * y
+			template <std::size_t A = 0, typename T>
+			void mul(std::size_t n, const T* x, const T* y, T* z) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1) {
+					for (; i < detail::vector_part<T>(n); i += S::width)
+						S::template store<Al>(z + i, S::mul(S::template load<Al>(x + i), S::template load<Al>(y + i)));
+				}
+				for (; i < n; ++i) z[i] = x[i] * y[i];
+			}
+
+			//z = x / y
+			template <std::size_t A = 0, typename T>
+			void div(std::size_t n, const T* x, const T* y, T* z) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1) {
+					for (; i < detail::vector_part<T>(n); i += S::width)
+						S::template store<Al>(z + i, S::div(S::template load<Al>(x + i), S::template load<Al>(y + i)));
+				}
+				for (; i < n; ++i) z[i] = x[i] / y[i];
+			}
+
+			//w = x * y + z
+			template <std::size_t A = 0, typename T>
+			void fmadd(std::size_t n, const T* x, const T* y, const T* z, T* w) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1) {
+					for (; i < detail::vector_part<T>(n); i += S::width)
+						S::template store<Al>(w + i, S::fmadd(S::template load<Al>(x + i), S::template load<Al>(y + i), S::template load<Al>(z + i)));
+				}
+				for (; i < n; ++i) w[i] = x[i] * y[i] + z[i];
+			}
+
+			//y = a * x, the elements of x are converted to T if U differs from T
+			template <std::size_t A = 0, typename T, typename U>
+			void scaled_copy(std::size_t n, detail::scalar_t<T> a, const U* x, T* y) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				if constexpr (S::width > 1 && std::is_same<T, U>::value) {
+					auto va = S::set1(a);
+					for (; i < detail::vector_part<T>(n); i += S::width) S::template store<Al>(y + i, S::mul(va, S::template load<Al>(x + i)));
+				}
+				for (; i < n; ++i) y[i] = a * static_cast<T>(x[i]);
+			}
+
+			//sum of x[i] * y[i]
+			template <std::size_t A = 0, typename T>
+			[[nodiscard]] T dot(std::size_t n, const T* x, const T* y) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				T ans = T();
+				if constexpr (S::width > 1) {
+					//two independent accumulators to hide the latency of the FMA chain
+					auto acc0 = S::set1(T(0));
+					auto acc1 = S::set1(T(0));
+					for (; i + 2 * S::width <= n; i += 2 * S::width) {
+						acc0 = S::fmadd(S::template load<Al>(x + i), S::template load<Al>(y + i), acc0);
+						acc1 = S::fmadd(S::template load<Al>(x + i + S::width), S::template load<Al>(y + i + S::width), acc1);
+					}
+					for (; i < detail::vector_part<T>(n); i += S::width)
+						acc0 = S::fmadd(S::template load<Al>(x + i), S::template load<Al>(y + i), acc0);
+					ans = S::hsum(S::add(acc0, acc1));
+				}
+				for (; i < n; ++i) ans += x[i] * y[i];
+				return ans;
+			}
+
+			//sum of |x[i]|
+			template <std::size_t A = 0, typename T>
+			[[nodiscard]] auto norm1(std::size_t n, const T* x) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				decltype(std::abs(x[0])) ans = 0;
+				if constexpr (S::width > 1) {
+					auto acc = S::set1(T(0));
+					for (; i < detail::vector_part<T>(n); i += S::width) acc = S::add(acc, S::abs(S::template load<Al>(x + i)));
+					ans = S::hsum(acc);
+				}
+				for (; i < n; ++i) ans += std::abs(x[i]);
+				return ans;
+			}
+
+			//sqrt of the sum of |x[i]|^2
+			template <std::size_t A = 0, typename T>
+			[[nodiscard]] auto norm2(std::size_t n, const T* x) {
+				if constexpr (detail::simd<T>::width > 1) {
+					return std::sqrt(dot<A>(n, x, x));
+				}
+				else {
+					decltype(std::abs(x[0])) ans = 0;
+					for (std::size_t i = 0; i < n; ++i) {
+						auto a = std::abs(x[i]);
+						ans += a * a;
+					}
+					return std::sqrt(ans);
+				}
+			}
+
+			//max of |x[i]|
+			template <std::size_t A = 0, typename T>
+			[[nodiscard]] auto norm_inf(std::size_t n, const T* x) {
+				using S = detail::simd<T>;
+				constexpr bool Al = detail::aligned<T, A>;
+				std::size_t i = 0;
+				decltype(std::abs(x[0])) ans = 0;
+				if constexpr (S::width > 1) {
+					auto acc = S::set1(T(0));
+					for (; i < detail::vector_part<T>(n); i += S::width) acc = S::max(acc, S::abs(S::template load<Al>(x + i)));
+					ans = S::hmax(acc);
+				}
+				for (; i < n; ++i) ans = std::abs(x[i]) > ans ? std::abs(x[i]) : ans;
+				return ans;
+			}
+
+			namespace detail {
+				//contiguous arrays: ArrayCPU, ArrayCPUView (e.g. the fields of a FieldBundle) and the other classes deriving ArrayCPUBase
+				template <class X>
+				constexpr bool is_array = std::is_base_of<ArrayCPUBase, std::decay_t<X>>::value;
+				template <class X>
+				using element_t = std::remove_const_t<std::remove_pointer_t<decltype(std::declval<const std::decay_t<X>&>().pointer())>>;
+				//alignment guaranteed by all operands
+				template <class X, class... Xs>
+				constexpr std::size_t alignment() {
+					constexpr std::size_t a = std::decay_t<X>::Alignment;
+					if constexpr (sizeof...(Xs) == 0) return a;
+					else return a < alignment<Xs...>() ? a : alignment<Xs...>();
+				}
+				template <class X, class... Xs>
+				constexpr bool same_elements = is_array<X> && ((is_array<Xs> && std::is_same<element_t<X>, element_t<Xs>>::value) && ...);
+			}
+
+			//overloads for arrays, sizes are checked against the output array
+			//the output may be a temporary view, hence the forwarding references
+
+			template <class Y, std::enable_if_t<detail::is_array<Y>, int> = 0>
+			void fill(Y&& y, detail::scalar_t<detail::element_t<Y>> val) { fill<detail::alignment<Y>()>(y.size_, val, y.pointer()); }
+
+			template <class Y, std::enable_if_t<detail::is_array<Y>, int> = 0>
+			void scale(detail::scalar_t<detail::element_t<Y>> a, Y&& y) { scale<detail::alignment<Y>()>(y.size_, a, y.pointer()); }
+
+			template <class X, class Y, std::enable_if_t<detail::same_elements<X, Y>, int> = 0>
+			void axpy(detail::scalar_t<detail::element_t<Y>> a, const X& x, Y&& y) {
+				if (x.size_ < y.size_) throw std::logic_error("axpy can not be done with an input array smaller than the output one");
+				axpy<detail::alignment<X, Y>()>(y.size_, a, x.pointer(), y.pointer());
+			}
+
+			template <class X, class Y, std::enable_if_t<detail::same_elements<X, Y>, int> = 0>
+			void axpby(detail::scalar_t<detail::element_t<Y>> a, const X& x, detail::scalar_t<detail::element_t<Y>> b, Y&& y) {
+				if (x.size_ < y.size_) throw std::logic_error("axpby can not be done with an input array smaller than the output one");
+				axpby<detail::alignment<X, Y>()>(y.size_, a, x.pointer(), b, y.pointer());
+			}
+
+			template <class X, class Y, class Z, std::enable_if_t<detail::same_elements<X, Y, Z>, int> = 0>
+			void mul(const X& x, const Y& y, Z&& z) {
+				if (x.size_ < z.size_ || y.size_ < z.size_) throw std::logic_error("mul can not be done with an input array smaller than the output one");
+				mul<detail::alignment<X, Y, Z>()>(z.size_, x.pointer(), y.pointer(), z.pointer());
+			}
+
+			template <class X, class Y, class Z, std::enable_if_t<detail::same_elements<X, Y, Z>, int> = 0>
+			void div(const X& x, const Y& y, Z&& z) {
+				if (x.size_ < z.size_ || y.size_ < z.size_) throw std::logic_error("div can not be done with an input array smaller than the output one");
+				div<detail::alignment<X, Y, Z>()>(z.size_, x.pointer(), y.pointer(), z.pointer());
+			}
+
+			template <class X, class Y, class Z, class W, std::enable_if_t<detail::same_elements<X, Y, Z, W>, int> = 0>
+			void fmadd(const X& x, const Y& y, const Z& z, W&& w) {
+				if (x.size_ < w.size_ || y.size_ < w.size_ || z.size_ < w.size_) throw std::logic_error("fmadd can not be done with an input array smaller than the output one");
+				fmadd<detail::alignment<X, Y, Z, W>()>(w.size_, x.pointer(), y.pointer(), z.pointer(), w.pointer());
+			}
+
+			template <class X, class Y, std::enable_if_t<detail::is_array<X>&& detail::is_array<Y>, int> = 0>
+			void scaled_copy(detail::scalar_t<detail::element_t<Y>> a, const X& x, Y&& y) {
+				if (x.size_ < y.size_) throw std::logic_error("scaled_copy can not be done with an input array smaller than the output one");
+				scaled_copy<detail::alignment<X, Y>()>(y.size_, a, x.pointer(), y.pointer());
+			}
+
+			template <class X, class Y, std::enable_if_t<detail::same_elements<X, Y>, int> = 0>
+			[[nodiscard]] detail::element_t<X> dot(const X& x, const Y& y) {
+				if (x.size_ != y.size_) throw std::logic_error("dot can not be done between two arrays of different sizes");
+				return dot<detail::alignment<X, Y>()>(x.size_, x.pointer(), y.pointer());
+			}
+
+			template <class X, std::enable_if_t<detail::is_array<X>, int> = 0>
+			[[nodiscard]] auto norm1(const X& x) { return norm1<detail::alignment<X>()>(x.size_, x.pointer()); }
+
+			template <class X, std::enable_if_t<detail::is_array<X>, int> = 0>
+			[[nodiscard]] auto norm2(const X& x) { return norm2<detail::alignment<X>()>(x.size_, x.pointer()); }
+
+			template <class X, std::enable_if_t<detail::is_array<X>, int> = 0>
+			[[nodiscard]] auto norm_inf(const X& x) { return norm_inf<detail::alignment<X>()>(x.size_, x.pointer()); }
+		}
+	}
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/predef.h>
+#include "boost/align.hpp"
+#include "array_wrapper_cpu.h"
+#include "hbw_posix_allocator.h"
+#include "huge_page_allocator.h"
+#include "numa_allocator.h"
+
+#if BOOST_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace resource {
+			using resource_ptr = std::shared_ptr<std::pmr::memory_resource>;
+
+			//leaf resources, they obtain memory from the system
+
+			//boost aligned_alloc, the plain DDR heap
+			class ddr_resource : public std::pmr::memory_resource {
+			protected:
+				void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+					void* p = boost::alignment::aligned_alloc(alignment < sizeof(void*) ? sizeof(void*) : alignment, bytes ? bytes : 1);
+					if (!p) throw std::bad_alloc();
+					return p;
+				}
+				void do_deallocate(void* p, std::size_t, std::size_t) override { boost::alignment::aligned_free(p); }
+				bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return dynamic_cast<const ddr_resource*>(&other) != nullptr; }
+			};
+
+			//anonymous mappings of whole pages, so that page policies applied by the decorators below do not leak into other blocks
+			class mmap_resource : public std::pmr::memory_resource {
+			protected:
+				void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+#if BOOST_OS_LINUX
+					auto ps = numa::detail::page_size();
+					std::size_t length = round_up(bytes ? bytes : 1, ps);
+					std::size_t extra = alignment > ps ? alignment : 0;
+					void* p = mmap(nullptr, length + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+					if (p == MAP_FAILED) throw std::bad_alloc();
+					if (!extra) return p;
+					//unmap the parts before and after the aligned block
+					auto begin = reinterpret_cast<std::uintptr_t>(p);
+					auto aligned = round_up(begin, alignment);
+					if (aligned > begin) munmap(p, aligned - begin);
+					if (begin + length + extra > aligned + length) munmap(reinterpret_cast<void*>(aligned + length), begin + length + extra - aligned - length);
+					return reinterpret_cast<void*>(aligned);
+#else
+					void* p = boost::alignment::aligned_alloc(alignment < sizeof(void*) ? sizeof(void*) : alignment, bytes ? bytes : 1);
+					if (!p) throw std::bad_alloc();
+					return p;
+#endif
+				}
+				void do_deallocate(void* p, std::size_t bytes, std::size_t) override {
+#if BOOST_OS_LINUX
+					munmap(p, round_up(bytes ? bytes : 1, numa::detail::page_size()));
+#else
+					boost::alignment::aligned_free(p);
+#endif
+				}
+				bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return dynamic_cast<const mmap_resource*>(&other) != nullptr; }
+			private:
+				static std::size_t round_up(std::size_t n, std::size_t unit) { return (n + unit - 1) / unit * unit; }
+			};
+
+			//high bandwidth memory, falling back to DDR according to hbw::get_policy()
+			class hbw_resource : public std::pmr::memory_resource {
+			protected:
+				void* do_allocate(std::size_t bytes, std::size_t alignment) override { return hbw::detail::allocate(alignment, bytes ? bytes : 1); }
+				void do_deallocate(void* p, std::size_t, std::size_t) override { hbw::detail::deallocate(p); }
+				bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return dynamic_cast<const hbw_resource*>(&other) != nullptr; }
+			};
+
+			//decorators, they take memory from an upstream resource and apply a page policy to it before it is touched
+			//put them directly over mmap_resource or over each other, since the policy covers whole pages
+
+			//blocks of at least huge_page::threshold() bytes are aligned and rounded to huge pages and advised with MADV_HUGEPAGE
+			class huge_page_resource : public std::pmr::memory_resource {
+			public:
+				explicit huge_page_resource(resource_ptr upstream) : upstream_(std::move(upstream)) {}
+			protected:
+				void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+					if (bytes < huge_page::threshold()) return upstream_->allocate(bytes, alignment);
+					auto hp = huge_page::size();
+					void* p = upstream_->allocate(round_up(bytes, hp), alignment > hp ? alignment : hp);
+#if BOOST_OS_LINUX && defined(MADV_HUGEPAGE)
+					madvise(p, round_up(bytes, hp), MADV_HUGEPAGE);
+#endif
+					return p;
+				}
+				void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+					if (bytes < huge_page::threshold()) return upstream_->deallocate(p, bytes, alignment);
+					auto hp = huge_page::size();
+					upstream_->deallocate(p, round_up(bytes, hp), alignment > hp ? alignment : hp);
+				}
+				bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+			private:
+				static std::size_t round_up(std::size_t n, std::size_t unit) { return (n + unit - 1) / unit * unit; }
+				resource_ptr upstream_;
+			};
+
+			enum class numa_policy { local, interleave, bind };
+
+			//blocks are rounded to whole pages and placed according to the policy, see numa_allocator.h
+			class numa_resource : public std::pmr::memory_resource {
+			public:
+				numa_resource(resource_ptr upstream, numa_policy policy, int node = 0) : upstream_(std::move(upstream)), policy_(policy), node_(node) {}
+			protected:
+				void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+					auto ps = numa::detail::page_size();
+					std::size_t length = round_up(bytes ? bytes : 1, ps);
+					void* p = upstream_->allocate(length, alignment > ps ? alignment : ps);
+					switch (policy_) {
+					case numa_policy::interleave: numa::interleave_range(p, length); break;
+					case numa_policy::bind: numa::bind_range(p, length, node_); break;
+					default: numa::local_range(p, length); break;
+					}
+					return p;
+				}
+				void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+					auto ps = numa::detail::page_size();
+					upstream_->deallocate(p, round_up(bytes ? bytes : 1, ps), alignment > ps ? alignment : ps);
+				}
+				bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+			private:
+				static std::size_t round_up(std::size_t n, std::size_t unit) { return (n + unit - 1) / unit * unit; }
+				resource_ptr upstream_;
+				numa_policy policy_;
+				int node_;
+			};
+
+			namespace detail {
+				struct upstream_holder {
+					resource_ptr upstream_;
+				};
+			}
+
+			//wraps one of the std::pmr resources taking a raw upstream pointer, keeping the upstream alive
+			//the holder is a base preceding Resource, so the upstream is destroyed after Resource has released its memory into it
+			template <class Resource>
+			class owning : private detail::upstream_holder, public Resource {
+			public:
+				template <class... Args>
+				explicit owning(resource_ptr upstream, Args&&... args) : detail::upstream_holder{ std::move(upstream) }, Resource(std::forward<Args>(args)..., upstream_.get()) {}
+			};
+
+			namespace detail {
+				inline std::vector<std::string> split(const std::string& s, char delimiter) {
+					std::vector<std::string> ans;
+					std::size_t pos = 0;
+					for (;;) {
+						auto next = s.find(delimiter, pos);
+						ans.push_back(s.substr(pos, next == std::string::npos ? std::string::npos : next - pos));
+						if (next == std::string::npos) return ans;
+						pos = next + 1;
+					}
+				}
+
+				//stages that must not be shared between threads
+				inline bool unsynchronized(const std::string& stage) { return stage == "pool_unsync" || stage == "monotonic"; }
+			}
+
+			//builds a chain of resources from a description like "pool/huge_page/numa:bind=0/mmap"
+			//stages are separated by '/', the first one is used by the arrays, each one takes memory from the next
+			//leaves: ddr, mmap, hbw
+			//decorators: pool (std::pmr::synchronized_pool_resource, sync_pool is the same), pool_unsync (std::pmr::unsynchronized_pool_resource),
+			//            monotonic (arena, freed only when the resource is destroyed), huge_page, numa:local, numa:interleave, numa:bind=N
+			//a chain ending with a decorator gets ddr (mmap below huge_page and numa) as its leaf
+			//all stages are thread-safe except pool_unsync and monotonic, chains with these may only be used by one thread at a time,
+			//e.g. through scoped_default, and set_default refuses them
+			[[nodiscard]] inline resource_ptr make(const std::string& description) {
+				auto stages = detail::split(description, '/');
+				resource_ptr ans;
+				for (auto it = stages.rbegin(); it != stages.rend(); ++it) {
+					auto colon = it->find(':');
+					auto name = it->substr(0, colon);
+					auto arg = colon == std::string::npos ? std::string() : it->substr(colon + 1);
+					bool leaf = name == "ddr" || name == "mmap" || name == "hbw";
+					if (leaf && ans) throw std::invalid_argument("Memory resource " + name + " can only be the last stage of " + description);
+					if (!leaf && !ans) ans = (name == "huge_page" || name == "numa") ? resource_ptr(std::make_shared<mmap_resource>()) : resource_ptr(std::make_shared<ddr_resource>());
+					if (name == "ddr") ans = std::make_shared<ddr_resource>();
+					else if (name == "mmap") ans = std::make_shared<mmap_resource>();
+					else if (name == "hbw") ans = std::make_shared<hbw_resource>();
+					else if (name == "pool" || name == "sync_pool") ans = std::make_shared<owning<std::pmr::synchronized_pool_resource>>(ans);
+					else if (name == "pool_unsync") ans = std::make_shared<owning<std::pmr::unsynchronized_pool_resource>>(ans);
+					else if (name == "monotonic") ans = std::make_shared<owning<std::pmr::monotonic_buffer_resource>>(ans);
+					else if (name == "huge_page") ans = std::make_shared<huge_page_resource>(ans);
+					else if (name == "numa" && (arg.empty() || arg == "local")) ans = std::make_shared<numa_resource>(ans, numa_policy::local);
+					else if (name == "numa" && arg == "interleave") ans = std::make_shared<numa_resource>(ans, numa_policy::interleave);
+					else if (name == "numa" && arg.compare(0, 5, "bind=") == 0) ans = std::make_shared<numa_resource>(ans, numa_policy::bind, std::stoi(arg.substr(5)));
+					else throw std::invalid_argument("Unknown memory resource " + *it + " in " + description);
+				}
+				return ans;
+			}
+
+			//true if the chain described can be shared between threads
+			[[nodiscard]] inline bool thread_safe(const std::string& description) {
+				for (const auto& stage : detail::split(description, '/'))
+					if (detail::unsynchronized(stage.substr(0, stage.find(':')))) return false;
+				return true;
+			}
+
+			namespace detail {
+				inline resource_ptr make_shared_default(const std::string& description) {
+					if (!thread_safe(description))
+						throw std::invalid_argument("Memory resource " + description + " is not thread-safe and can not be the default of all threads");
+					return make(description);
+				}
+
+				//resources ever installed as default are kept alive until exit, since arrays may outlive the installation
+				class Registry {
+				public:
+					static Registry& instance() {
+						static Registry* registry = new Registry();
+						return *registry;
+					}
+					std::pmr::memory_resource* install(resource_ptr r) {
+						std::lock_guard<std::mutex> lock(mutex_);
+						kept_.push_back(r);
+						current_.store(r.get());
+						return r.get();
+					}
+					std::pmr::memory_resource* current() const { return current_.load(); }
+				private:
+					//QUTILITY_MEMORY_RESOURCE holds a description for make(), ddr if unset
+					Registry() {
+						const char* s = std::getenv("QUTILITY_MEMORY_RESOURCE");
+						install(make_shared_default(s && *s ? s : "ddr"));
+					}
+					std::mutex mutex_;
+					std::vector<resource_ptr> kept_;
+					std::atomic<std::pmr::memory_resource*> current_{ nullptr };
+				};
+
+				inline std::pmr::memory_resource*& thread_override() {
+					thread_local std::pmr::memory_resource* r = nullptr;
+					return r;
+				}
+			}
+
+			//the resource used by arrays constructed from now on
+			[[nodiscard]] inline std::pmr::memory_resource* get_default() {
+				if (auto r = detail::thread_override()) return r;
+				return detail::Registry::instance().current();
+			}
+			//r is used by all threads, so it must be thread-safe
+			inline std::pmr::memory_resource* set_default(resource_ptr r) { return detail::Registry::instance().install(std::move(r)); }
+			//throws std::invalid_argument for descriptions that are not thread_safe()
+			inline std::pmr::memory_resource* set_default(const std::string& description) { return set_default(detail::make_shared_default(description)); }
+
+			//makes r the default of the calling thread while alive, r must outlive the arrays constructed meanwhile
+			class scoped_default {
+			public:
+				explicit scoped_default(std::pmr::memory_resource* r) : previous_(detail::thread_override()) { detail::thread_override() = r; }
+				scoped_default(const scoped_default&) = delete;
+				scoped_default& operator=(const scoped_default&) = delete;
+				~scoped_default() { detail::thread_override() = previous_; }
+			private:
+				std::pmr::memory_resource* previous_;
+			};
+		}
+
+		//allocator drawing from a memory resource with at least the alignment A
+		//a default constructed one, as used by ArrayCPU, takes resource::get_default() at that moment
+		template <class T, std::size_t Alignment>
+		class ResourceAllocator {
+		public:
+			using value_type = T;
+			using size_type = std::size_t;
+			using difference_type = std::ptrdiff_t;
+			using propagate_on_container_move_assignment = std::true_type;
+			using propagate_on_container_swap = std::true_type;
+
+			template <class U>
+			struct rebind {
+				using other = ResourceAllocator<U, Alignment>;
+			};
+
+			ResourceAllocator() noexcept : resource_(resource::get_default()) {}
+			ResourceAllocator(std::pmr::memory_resource* r) noexcept : resource_(r) {}
+			template <class U>
+			ResourceAllocator(const ResourceAllocator<U, Alignment>& rhs) noexcept : resource_(rhs.resource()) {}
+
+			[[nodiscard]] T* allocate(size_type n) {
+				if (n > static_cast<size_type>(-1) / sizeof(T)) throw std::bad_alloc();
+				return static_cast<T*>(resource_->allocate(n * sizeof(T), alignment()));
+			}
+			void deallocate(T* p, size_type n) { resource_->deallocate(p, n * sizeof(T), alignment()); }
+
+			[[nodiscard]] std::pmr::memory_resource* resource() const noexcept { return resource_; }
+
+		private:
+			constexpr static std::size_t alignment() { return Alignment > alignof(T) ? Alignment : alignof(T); }
+			std::pmr::memory_resource* resource_;
+		};
+
+		template <class T, class U, std::size_t Alignment>
+		bool operator==(const ResourceAllocator<T, Alignment>& lhs, const ResourceAllocator<U, Alignment>& rhs) {
+			return lhs.resource() == rhs.resource() || lhs.resource()->is_equal(*rhs.resource());
+		}
+
+		template <class T, class U, std::size_t Alignment>
+		bool operator!=(const ResourceAllocator<T, Alignment>& lhs, const ResourceAllocator<U, Alignment>& rhs) {
+			return !(lhs == rhs);
+		}
+
+		//array whose memory placement is chosen at runtime, through resource::set_default or resource::scoped_default
+		template <class T, std::size_t A = 64>
+		using DArrayResource = ArrayCPU<T, ResourceAllocator<T, A>, A>;
+	}
+}
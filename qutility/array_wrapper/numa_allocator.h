@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/predef.h>
+#include "boost/align.hpp"
+#include "array_wrapper_cpu.h"
+
+#if BOOST_OS_LINUX
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace numa {
+			//placement policies for NumaAllocator
+			//local: pages come from the node of the thread touching them first, whatever the process policy is
+			//interleave: pages are spread round-robin over all online nodes, for shared read-mostly tables
+			//bind<Node>: pages come from Node only
+			struct local {};
+			struct interleave {};
+			template <int Node>
+			struct bind {};
+
+			//pages of a range per node, as reported by the kernel
+			struct residence {
+				std::vector<std::size_t> pages_on_node;
+				std::size_t not_present = 0; //pages not faulted in yet
+				std::size_t page_size = 0;
+			};
+
+			namespace detail {
+				//the kernel constants from <numaif.h>, repeated here to avoid depending on libnuma
+				enum mempolicy : int { MPOL_DEFAULT_ = 0, MPOL_PREFERRED_ = 1, MPOL_BIND_ = 2, MPOL_INTERLEAVE_ = 3, MPOL_LOCAL_ = 4 };
+				constexpr unsigned MPOL_MF_MOVE_ = 1u << 1;
+
+				//parse lists like "0-3,5" from /sys/devices/system/node
+				inline std::vector<int> read_node_list(const char* filename) {
+					std::vector<int> ans;
+					std::ifstream ifs(filename);
+					std::string list;
+					if (!(ifs >> list)) return { 0 };
+					std::size_t pos = 0;
+					while (pos < list.size()) {
+						auto next = list.find(',', pos);
+						auto item = list.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+						auto dash = item.find('-');
+						int first = std::stoi(item.substr(0, dash));
+						int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+						for (int node = first; node <= last; ++node) ans.push_back(node);
+						if (next == std::string::npos) break;
+						pos = next + 1;
+					}
+					return ans.empty() ? std::vector<int>{ 0 } : ans;
+				}
+
+				inline std::size_t page_size() {
+#if BOOST_OS_LINUX
+					static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+					return size;
+#else
+					return 4096;
+#endif
+				}
+
+#if BOOST_OS_LINUX
+				inline bool mbind(void* p, std::size_t bytes, int mode, const std::vector<int>& nodes, bool move) {
+					constexpr std::size_t bits = 8 * sizeof(unsigned long);
+					int max = 0;
+					for (auto node : nodes) max = node > max ? node : max;
+					std::vector<unsigned long> mask(max / bits + 1, 0ul);
+					for (auto node : nodes) mask[node / bits] |= 1ul << (node % bits);
+					//the range must start at a page boundary
+					auto begin = reinterpret_cast<std::uintptr_t>(p) / page_size() * page_size();
+					auto length = reinterpret_cast<std::uintptr_t>(p) + bytes - begin;
+					unsigned long maxnode = nodes.empty() ? 0 : mask.size() * bits + 1;
+					return syscall(SYS_mbind, begin, length, mode, nodes.empty() ? nullptr : mask.data(), maxnode, move ? MPOL_MF_MOVE_ : 0u) == 0;
+				}
+#endif
+			}
+
+			[[nodiscard]] inline const std::vector<int>& online_nodes() {
+				static const std::vector<int> nodes = detail::read_node_list("/sys/devices/system/node/online");
+				return nodes;
+			}
+
+			//true if there is more than one node, otherwise every placement request below is a no-op
+			[[nodiscard]] inline bool available() { return online_nodes().size() > 1; }
+
+			//the functions below apply a policy to the pages covering [p, p + bytes)
+			//pages already faulted in are only migrated if move is true
+			//return false if the kernel refused the request, true on success or on single-node machines
+			inline bool bind_range(void* p, std::size_t bytes, int node, bool move = false) {
+#if BOOST_OS_LINUX
+				if (!available()) return true;
+				return detail::mbind(p, bytes, detail::MPOL_BIND_, { node }, move);
+#else
+				return true;
+#endif
+			}
+
+			inline bool interleave_range(void* p, std::size_t bytes, bool move = false) {
+#if BOOST_OS_LINUX
+				if (!available()) return true;
+				return detail::mbind(p, bytes, detail::MPOL_INTERLEAVE_, online_nodes(), move);
+#else
+				return true;
+#endif
+			}
+
+			inline bool local_range(void* p, std::size_t bytes, bool move = false) {
+#if BOOST_OS_LINUX
+				if (!available()) return true;
+				//MPOL_LOCAL needs Linux 3.8, MPOL_PREFERRED with an empty mask is the older spelling
+				return detail::mbind(p, bytes, detail::MPOL_LOCAL_, {}, move)
+					|| detail::mbind(p, bytes, detail::MPOL_PREFERRED_, {}, move);
+#else
+				return true;
+#endif
+			}
+
+			//where the pages of [p, p + bytes) actually reside
+			[[nodiscard]] inline residence query(const void* p, std::size_t bytes) {
+				residence ans;
+				ans.page_size = detail::page_size();
+				int max = 0;
+				for (auto node : online_nodes()) max = node > max ? node : max;
+				ans.pages_on_node.assign(max + 1, 0);
+				if (bytes == 0) return ans;
+				auto begin = reinterpret_cast<std::uintptr_t>(p) / ans.page_size * ans.page_size;
+				auto end = reinterpret_cast<std::uintptr_t>(p) + bytes;
+				std::vector<void*> pages;
+				for (auto addr = begin; addr < end; addr += ans.page_size) pages.push_back(reinterpret_cast<void*>(addr));
+#if BOOST_OS_LINUX
+				std::vector<int> status(pages.size(), -ENOENT);
+				if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0) {
+					ans.not_present = pages.size();
+					return ans;
+				}
+				for (auto s : status) {
+					if (s >= 0 && s <= max) ++ans.pages_on_node[s];
+					else ++ans.not_present;
+				}
+#else
+				ans.pages_on_node[0] = pages.size();
+#endif
+				return ans;
+			}
+
+			template <class T, class Allocator, size_t A>
+			[[nodiscard]] residence query(const ArrayCPU<T, Allocator, A>& arr) {
+				return query(arr.pointer(), arr.size_ * sizeof(T));
+			}
+		}
+
+		//allocator mapping whole pages and applying a NUMA policy before they are touched
+		//the policy sticks to the pages, so the first touch by the ArrayCPU constructor places them accordingly
+		template <class T, std::size_t Alignment, class Policy = numa::local>
+		class NumaAllocator {
+		public:
+			using value_type = T;
+			using size_type = std::size_t;
+			using difference_type = std::ptrdiff_t;
+
+			template <class U>
+			struct rebind {
+				using other = NumaAllocator<U, Alignment, Policy>;
+			};
+
+			NumaAllocator() noexcept {}
+			template <class U>
+			NumaAllocator(const NumaAllocator<U, Alignment, Policy>&) noexcept {}
+
+			[[nodiscard]] T* allocate(size_type n) {
+				if (n > static_cast<size_type>(-1) / sizeof(T)) throw std::bad_alloc();
+#if BOOST_OS_LINUX
+				//alignments beyond a page are met by mapping more and unmapping the parts before and after the aligned block
+				//so that the block never shares a page with other allocations the policy must not reach
+				std::size_t length = mapped_length(n * sizeof(T));
+				std::size_t extra = Alignment > numa::detail::page_size() ? Alignment : 0;
+				void* p = mmap(nullptr, length + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (p == MAP_FAILED) throw std::bad_alloc();
+				if (extra) {
+					auto begin = reinterpret_cast<std::uintptr_t>(p);
+					auto aligned = (begin + Alignment - 1) / Alignment * Alignment;
+					if (aligned > begin) munmap(p, aligned - begin);
+					if (begin + extra > aligned) munmap(reinterpret_cast<void*>(aligned + length), begin + extra - aligned);
+					p = reinterpret_cast<void*>(aligned);
+				}
+				apply(p, length);
+				return static_cast<T*>(p);
+#else
+				void* p = boost::alignment::aligned_alloc(Alignment, n * sizeof(T));
+				if (!p) throw std::bad_alloc();
+				apply(p, n * sizeof(T));
+				return static_cast<T*>(p);
+#endif
+			}
+
+			void deallocate(T* p, size_type n) {
+#if BOOST_OS_LINUX
+				munmap(static_cast<void*>(p), mapped_length(n * sizeof(T)));
+#else
+				boost::alignment::aligned_free(static_cast<void*>(p));
+#endif
+			}
+
+		private:
+			static std::size_t mapped_length(std::size_t bytes) {
+				auto ps = numa::detail::page_size();
+				return (bytes + ps - 1) / ps * ps;
+			}
+			//placement is best effort, a refused policy leaves the default one in place
+			static void apply(void* p, std::size_t bytes) {
+				if constexpr (std::is_same<Policy, numa::interleave>::value) numa::interleave_range(p, bytes);
+				else if constexpr (std::is_same<Policy, numa::local>::value) numa::local_range(p, bytes);
+				else apply_bind(p, bytes, Policy{});
+			}
+			template <int Node>
+			static void apply_bind(void* p, std::size_t bytes, numa::bind<Node>) { numa::bind_range(p, bytes, Node); }
+		};
+
+		template <class T, class U, std::size_t Alignment, class Policy>
+		bool operator==(const NumaAllocator<T, Alignment, Policy>&, const NumaAllocator<U, Alignment, Policy>&) {
+			return true;
+		}
+
+		template <class T, class U, std::size_t Alignment, class Policy>
+		bool operator!=(const NumaAllocator<T, Alignment, Policy>&, const NumaAllocator<U, Alignment, Policy>&) {
+			return false;
+		}
+
+		template <class T, class Policy = numa::local, std::size_t A = 64>
+		using DArrayDDRNuma = ArrayCPU<T, NumaAllocator<T, A, Policy>, A>;
+	}
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <boost/predef.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "boost/align.hpp"
+#include "../history.h"
+#include "array_wrapper_cpu.h"
+
+#if BOOST_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace detail {
+			//the storage is a base preceding the history, so that it exists when the history takes its pointer
+			template <class Storage>
+			struct history_storage {
+				Storage storage_;
+			};
+		}
+
+		//history owning N_hist * single_size contiguous elements, allocated through ArrayCPU
+		//records are aligned to A if single_size * sizeof(T) is a multiple of A
+		template<class T, class Allocator, size_t A>
+		class OwningHistory : private detail::history_storage<ArrayCPU<T, Allocator, A>>, public history::DHistory<T> {
+			using storage_base = detail::history_storage<ArrayCPU<T, Allocator, A>>;
+		public:
+			using array_type = ArrayCPU<T, Allocator, A>;
+
+			OwningHistory() = delete;
+			OwningHistory(std::size_t single_size, std::size_t N_hist)
+				: storage_base{ array_type(single_size * N_hist) }, history::DHistory<T>(storage_base::storage_.pointer(), single_size, N_hist) {}
+			OwningHistory(std::size_t single_size, std::size_t N_hist, uninitialized_t)
+				: storage_base{ array_type(single_size * N_hist, uninitialized) }, history::DHistory<T>(storage_base::storage_.pointer(), single_size, N_hist) {}
+			OwningHistory(std::size_t single_size, std::size_t N_hist, first_touch_t ft)
+				: storage_base{ array_type(single_size * N_hist, ft) }, history::DHistory<T>(storage_base::storage_.pointer(), single_size, N_hist) {}
+			OwningHistory(const OwningHistory&) = delete;
+			OwningHistory& operator=(const OwningHistory&) = delete;
+			OwningHistory(OwningHistory&&) = default;
+
+			//all records as one array, in ring order
+			[[nodiscard]] const array_type& storage() const noexcept { return storage_base::storage_; }
+			[[nodiscard]] array_type& storage() noexcept { return storage_base::storage_; }
+		};
+
+		template <class T, std::size_t A = 64>
+		using DHistoryDDR = OwningHistory<T, boost::alignment::aligned_allocator<T, A>, A>;
+
+		namespace mapped_history {
+			//directory of the scratch files: the environment variable QUTILITY_SCRATCH_DIR, or the system temporary directory
+			inline std::filesystem::path default_directory() {
+				if (const char* dir = std::getenv("QUTILITY_SCRATCH_DIR")) return dir;
+				return std::filesystem::temp_directory_path();
+			}
+
+			namespace detail {
+				inline std::filesystem::path unique_file(const std::filesystem::path& directory) {
+					static std::atomic<unsigned long> counter{ 0 };
+					std::random_device rd;
+					return directory / ("qutility_history_" + std::to_string(rd()) + "_" + std::to_string(counter++) + ".bin");
+				}
+
+				//a scratch file of the given size mapped read-write, the file is deleted as early as the OS allows
+				class mapping {
+				public:
+					mapping(const std::filesystem::path& directory, std::size_t bytes) : path_(unique_file(directory)) {
+						{
+							std::ofstream file(path_, std::ios::binary);
+							if (!file) throw std::runtime_error("Cannot create the scratch file " + path_.string());
+						}
+						std::error_code ec;
+						std::filesystem::resize_file(path_, bytes, ec);
+						if (ec) {
+							std::filesystem::remove(path_, ec);
+							throw std::runtime_error("Cannot resize the scratch file " + path_.string());
+						}
+						try {
+							boost::interprocess::file_mapping file(path_.string().c_str(), boost::interprocess::read_write);
+							region_ = boost::interprocess::mapped_region(file, boost::interprocess::read_write, 0, bytes);
+						}
+						catch (...) {
+							std::filesystem::remove(path_, ec);
+							throw;
+						}
+#if !BOOST_OS_WINDOWS
+						std::filesystem::remove(path_, ec); //the mapping keeps the data alive
+						path_.clear();
+#endif
+					}
+					mapping(const mapping&) = delete;
+					mapping& operator=(const mapping&) = delete;
+					mapping(mapping&& rhs) noexcept : path_(std::move(rhs.path_)), region_(std::move(rhs.region_)) { rhs.path_.clear(); }
+					~mapping() {
+						region_ = boost::interprocess::mapped_region();
+						std::error_code ec;
+						if (!path_.empty()) std::filesystem::remove(path_, ec);
+					}
+
+					[[nodiscard]] void* address() const noexcept { return region_.get_address(); }
+
+				private:
+					std::filesystem::path path_;
+					boost::interprocess::mapped_region region_;
+				};
+			}
+		}
+
+		//history whose records live in a memory-mapped scratch file, for N_hist beyond the available memory
+		//push() asks the OS to write back and drop the record that falls out of the resident most recent ones
+		//older records are still readable, they are paged in from the file on access
+		//only the whole pages inside a record are advised, and pushes through a HistoryBase reference do not advise at all
+		template<class T>
+		class MappedHistory : private detail::history_storage<mapped_history::detail::mapping>, public history::DHistory<T> {
+			using storage_base = detail::history_storage<mapped_history::detail::mapping>;
+			static_assert(std::is_trivially_copyable<T>::value, "Records in a file mapping must be trivially copyable");
+		public:
+			MappedHistory() = delete;
+			MappedHistory(std::size_t single_size, std::size_t N_hist, std::size_t resident, const std::filesystem::path& directory = mapped_history::default_directory())
+				: storage_base{ mapped_history::detail::mapping(directory, single_size * N_hist * sizeof(T)) },
+				history::DHistory<T>(static_cast<T*>(storage_base::storage_.address()), single_size, N_hist), resident_(resident) {}
+			MappedHistory(const MappedHistory&) = delete;
+			MappedHistory& operator=(const MappedHistory&) = delete;
+			MappedHistory(MappedHistory&&) = default;
+
+			MappedHistory& push() {
+				history::DHistory<T>::push();
+				if (this->N_record_ > resident_ && resident_ < this->N_hist_) evict(this->N_record_ - resident_ - 1);
+				return *this;
+			}
+
+			//number of most recent records kept in memory
+			[[nodiscard]] std::size_t resident() const noexcept { return resident_; }
+			void set_resident(std::size_t resident) noexcept { resident_ = resident; }
+
+		private:
+			void evict(std::size_t record) const noexcept {
+#if BOOST_OS_LINUX
+				const std::size_t page = boost::interprocess::mapped_region::get_page_size();
+				auto begin = reinterpret_cast<std::uintptr_t>(this->base_ptr_ + (record % this->N_hist_) * this->single_size_);
+				auto end = begin + this->single_size_ * sizeof(T);
+				begin = (begin + page - 1) / page * page;
+				end = end / page * page;
+				if (begin >= end) return;
+#if defined(MADV_PAGEOUT)
+				madvise(reinterpret_cast<void*>(begin), end - begin, MADV_PAGEOUT);
+#else
+				madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+#else
+				(void)record;
+#endif
+			}
+
+			std::size_t resident_;
+		};
+	}
+}
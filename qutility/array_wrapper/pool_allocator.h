@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "boost/align.hpp"
+#include "hbw_posix_allocator.h"
+#include "array_wrapper_cpu.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace pool {
+			//shared: one pool per allocator type for the whole process, guarded by a mutex
+			//thread: one pool per allocator type and thread, blocks are cached by the thread releasing them
+			enum class scope { shared, thread };
+
+			struct statistics {
+				std::size_t hits = 0;           //allocations served from the cache
+				std::size_t misses = 0;         //allocations forwarded to the upstream allocator
+				std::size_t cached_blocks = 0;  //blocks currently kept for reuse
+				std::size_t cached_bytes = 0;
+				//net bytes obtained from upstream, in use or cached
+				//with pool::scope::thread a block obtained by one thread may be returned through another one
+				std::ptrdiff_t upstream_bytes = 0;
+			};
+
+			namespace detail {
+				//bytes are rounded up so that at most 3 bits below the leading one are set
+				//i.e. there are 8 size classes per octave and at most 12.5% of a block is wasted
+				[[nodiscard]] inline std::size_t size_class(std::size_t bytes) noexcept {
+					if (bytes <= 64) return 64;
+					std::size_t lead = 1;
+					while ((lead << 1) <= bytes) lead <<= 1;
+					std::size_t step = lead >> 3;
+					return (bytes + step - 1) / step * step;
+				}
+
+				struct no_mutex {
+					void lock() noexcept {}
+					void unlock() noexcept {}
+				};
+
+				template <class ByteAllocator, class Mutex>
+				class BufferPool {
+				public:
+					BufferPool() = default;
+					BufferPool(const BufferPool&) = delete;
+					BufferPool& operator=(const BufferPool&) = delete;
+					~BufferPool() { trim(); }
+
+					void* allocate(std::size_t bytes) {
+						auto sc = size_class(bytes);
+						{
+							std::lock_guard<Mutex> lock(mutex_);
+							auto it = free_.find(sc);
+							if (it != free_.end() && !it->second.empty()) {
+								void* p = it->second.back();
+								it->second.pop_back();
+								++stats_.hits;
+								--stats_.cached_blocks;
+								stats_.cached_bytes -= sc;
+								return p;
+							}
+							++stats_.misses;
+						}
+						ByteAllocator upstream;
+						void* p = upstream.allocate(sc);
+						std::lock_guard<Mutex> lock(mutex_);
+						stats_.upstream_bytes += static_cast<std::ptrdiff_t>(sc);
+						return p;
+					}
+
+					void deallocate(void* p, std::size_t bytes) {
+						auto sc = size_class(bytes);
+						{
+							std::lock_guard<Mutex> lock(mutex_);
+							if (stats_.cached_bytes + sc <= max_cached_bytes_) {
+								free_[sc].push_back(p);
+								++stats_.cached_blocks;
+								stats_.cached_bytes += sc;
+								return;
+							}
+							stats_.upstream_bytes -= static_cast<std::ptrdiff_t>(sc);
+						}
+						ByteAllocator upstream;
+						upstream.deallocate(static_cast<char*>(p), sc);
+					}
+
+					//return all cached blocks to the upstream allocator
+					void trim() {
+						std::unordered_map<std::size_t, std::vector<void*>> released;
+						{
+							std::lock_guard<Mutex> lock(mutex_);
+							released.swap(free_);
+							stats_.upstream_bytes -= static_cast<std::ptrdiff_t>(stats_.cached_bytes);
+							stats_.cached_blocks = 0;
+							stats_.cached_bytes = 0;
+						}
+						ByteAllocator upstream;
+						for (auto& [sc, blocks] : released)
+							for (auto p : blocks)
+								upstream.deallocate(static_cast<char*>(p), sc);
+					}
+
+					//blocks released while the cache holds more than max_bytes go back to upstream directly
+					void set_max_cached_bytes(std::size_t max_bytes) {
+						std::lock_guard<Mutex> lock(mutex_);
+						max_cached_bytes_ = max_bytes;
+					}
+
+					[[nodiscard]] statistics stats() const {
+						std::lock_guard<Mutex> lock(mutex_);
+						return stats_;
+					}
+
+				private:
+					mutable Mutex mutex_;
+					std::unordered_map<std::size_t, std::vector<void*>> free_;
+					statistics stats_;
+					std::size_t max_cached_bytes_ = static_cast<std::size_t>(-1);
+				};
+			}
+		}
+
+		//allocator caching released blocks by size class instead of returning them to Upstream
+		//Upstream is rebound to char and must be stateless, its alignment is inherited by every block
+		template <class T, std::size_t Alignment, class Upstream = boost::alignment::aligned_allocator<char, Alignment>, pool::scope Scope = pool::scope::shared>
+		class PoolAllocator {
+		public:
+			using value_type = T;
+			using size_type = std::size_t;
+			using difference_type = std::ptrdiff_t;
+			using byte_allocator = typename std::allocator_traits<Upstream>::template rebind_alloc<char>;
+			using pool_type = pool::detail::BufferPool<byte_allocator, std::conditional_t<Scope == pool::scope::shared, std::mutex, pool::detail::no_mutex>>;
+
+			template <class U>
+			struct rebind {
+				using other = PoolAllocator<U, Alignment, Upstream, Scope>;
+			};
+
+			PoolAllocator() noexcept {}
+			template <class U>
+			PoolAllocator(const PoolAllocator<U, Alignment, Upstream, Scope>&) noexcept {}
+
+			[[nodiscard]] T* allocate(size_type n) {
+				if (n > static_cast<size_type>(-1) / sizeof(T)) throw std::bad_alloc();
+				if (auto p = pool_pointer()) return static_cast<T*>(p->allocate(n * sizeof(T)));
+				byte_allocator upstream;
+				return reinterpret_cast<T*>(upstream.allocate(pool::detail::size_class(n * sizeof(T))));
+			}
+			void deallocate(T* p, size_type n) {
+				if (auto pp = pool_pointer()) return pp->deallocate(static_cast<void*>(p), n * sizeof(T));
+				byte_allocator upstream;
+				upstream.deallocate(reinterpret_cast<char*>(p), pool::detail::size_class(n * sizeof(T)));
+			}
+
+			//all allocators with the same Alignment, Upstream and Scope share one pool (per thread for pool::scope::thread)
+			//the pool of a thread is destroyed at thread exit, calling pool() afterwards on that thread throws
+			static pool_type& pool() {
+				auto p = pool_pointer();
+				if (!p) throw std::logic_error("The pool of this thread has already been destroyed");
+				return *p;
+			}
+			static void trim() { pool().trim(); }
+			static void set_max_cached_bytes(std::size_t max_bytes) { pool().set_max_cached_bytes(max_bytes); }
+			[[nodiscard]] static pool::statistics statistics() { return pool().stats(); }
+
+		private:
+			//nullptr once the pool of the calling thread is destroyed
+			//blocks released after that, e.g. by arrays with static or thread storage duration destroyed later, go to upstream directly
+			//this is safe because every block has the size class as its size in upstream, whichever pool it went through
+			static pool_type* pool_pointer() {
+				if constexpr (Scope == pool::scope::shared) {
+					//never destroyed, so that arrays with static storage duration can still return their blocks
+					static pool_type* instance = new pool_type();
+					return instance;
+				}
+				else {
+					if (thread_pool_gone()) return nullptr;
+					thread_local thread_pool holder;
+					return &holder.pool;
+				}
+			}
+			struct thread_pool {
+				pool_type pool;
+				~thread_pool() { thread_pool_gone() = true; }
+			};
+			//trivially destructible, hence still usable while the other thread_local objects are destroyed
+			static bool& thread_pool_gone() noexcept {
+				thread_local bool gone = false;
+				return gone;
+			}
+		};
+
+		template <class T, class U, std::size_t Alignment, class Upstream, pool::scope Scope>
+		bool operator==(const PoolAllocator<T, Alignment, Upstream, Scope>&, const PoolAllocator<U, Alignment, Upstream, Scope>&) {
+			return true;
+		}
+
+		template <class T, class U, std::size_t Alignment, class Upstream, pool::scope Scope>
+		bool operator!=(const PoolAllocator<T, Alignment, Upstream, Scope>&, const PoolAllocator<U, Alignment, Upstream, Scope>&) {
+			return false;
+		}
+
+		template <class T, std::size_t A = 64, pool::scope Scope = pool::scope::shared>
+		using DArrayDDRPool = ArrayCPU<T, PoolAllocator<T, A, boost::alignment::aligned_allocator<char, A>, Scope>, A>;
+
+		template <class T, std::size_t A = 64, pool::scope Scope = pool::scope::shared>
+		using DArrayHBWPool = ArrayCPU<T, PoolAllocator<T, A, hbw::allocator<char, A>, Scope>, A>;
+	}
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include "../parallel.h"
+#include "../history.h"
+#include "array_wrapper_cpu.h"
+#include "copy_engine.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace precision {
+			//storage-only formats, convert them to float or double for any arithmetic
+			//conversions from float round to nearest even, as the hardware instructions do
+
+			namespace detail {
+				inline std::uint32_t bits_of(float f) noexcept {
+					std::uint32_t x;
+					std::memcpy(&x, &f, sizeof(x));
+					return x;
+				}
+				inline float float_of(std::uint32_t x) noexcept {
+					float f;
+					std::memcpy(&f, &x, sizeof(f));
+					return f;
+				}
+
+				inline std::uint16_t float_to_half(float f) noexcept {
+					std::uint32_t x = bits_of(f);
+					std::uint32_t sign = (x >> 16) & 0x8000u;
+					std::uint32_t abs = x & 0x7FFFFFFFu;
+					if (abs > 0x7F800000u) //nan, quieted with the upper payload bits kept as vcvtps2ph does
+						return static_cast<std::uint16_t>(sign | 0x7E00u | ((abs >> 13) & 0x3FFu));
+					if (abs >= 0x47800000u) //overflow or inf
+						return static_cast<std::uint16_t>(sign | 0x7C00u);
+					if (abs < 0x38800000u) { //subnormal half or zero, adding 0.5f leaves the rounded half mantissa in the low bits
+						std::uint32_t r = bits_of(float_of(abs) + 0.5f) - 0x3F000000u;
+						return static_cast<std::uint16_t>(sign | r);
+					}
+					std::uint32_t odd = (abs >> 13) & 1u;
+					abs += 0xC8000FFFu + odd; //rebias the exponent from 127 to 15 and round
+					return static_cast<std::uint16_t>(sign | (abs >> 13));
+				}
+
+				inline float half_to_float(std::uint16_t h) noexcept {
+					std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000u) << 16;
+					std::uint32_t exp = (h >> 10) & 0x1Fu;
+					std::uint32_t mant = h & 0x3FFu;
+					if (exp == 0) {
+						float f = static_cast<float>(mant) * (1.0f / 16777216.0f);
+						return float_of(sign | bits_of(f));
+					}
+					if (exp == 31) return float_of(sign | 0x7F800000u | (mant << 13) | (mant ? 0x400000u : 0u)); //nan is quieted
+					return float_of(sign | ((exp + 112) << 23) | (mant << 13));
+				}
+
+				inline std::uint16_t float_to_bfloat16(float f) noexcept {
+					std::uint32_t x = bits_of(f);
+					if ((x & 0x7FFFFFFFu) > 0x7F800000u) return static_cast<std::uint16_t>((x >> 16) | 0x40u); //keep nan quiet
+					return static_cast<std::uint16_t>((x + 0x7FFFu + ((x >> 16) & 1u)) >> 16);
+				}
+
+				inline float bfloat16_to_float(std::uint16_t b) noexcept { return float_of(static_cast<std::uint32_t>(b) << 16); }
+			}
+
+			//trivial like float, so that uninitialized arrays leave them untouched, half{} and value-initialized arrays give zero
+			struct half {
+				std::uint16_t bits;
+				half() = default;
+				explicit half(float f) noexcept : bits(detail::float_to_half(f)) {}
+				explicit operator float() const noexcept { return detail::half_to_float(bits); }
+			};
+
+			struct bfloat16 {
+				std::uint16_t bits;
+				bfloat16() = default;
+				explicit bfloat16(float f) noexcept : bits(detail::float_to_bfloat16(f)) {}
+				explicit operator float() const noexcept { return detail::bfloat16_to_float(bits); }
+			};
+
+			static_assert(std::is_trivial<half>::value && sizeof(half) == 2, "half must be a trivial 16-bit type");
+			static_assert(std::is_trivial<bfloat16>::value && sizeof(bfloat16) == 2, "bfloat16 must be a trivial 16-bit type");
+
+			template <class T>
+			struct is_storage : std::false_type {};
+			template <>
+			struct is_storage<half> : std::true_type {};
+			template <>
+			struct is_storage<bfloat16> : std::true_type {};
+
+			//pairs handled by convert(), in both directions
+			template <class From, class To>
+			constexpr bool convertible =
+				(is_storage<From>::value && (std::is_same<To, float>::value || std::is_same<To, double>::value)) ||
+				(is_storage<To>::value && (std::is_same<From, float>::value || std::is_same<From, double>::value)) ||
+				(std::is_same<From, float>::value && std::is_same<To, double>::value) ||
+				(std::is_same<From, double>::value && std::is_same<To, float>::value);
+
+			namespace detail {
+				//float <-> storage, vectorized with the widest instructions enabled at compile time
+
+				inline void widen(std::size_t n, const half* src, float* dst) {
+					std::size_t i = 0;
+					auto s = reinterpret_cast<const std::uint16_t*>(src);
+#if defined(__AVX512F__)
+					for (; i + 16 <= n; i += 16) _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i))));
+#elif defined(__F16C__)
+					for (; i + 8 <= n; i += 8) _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i))));
+#endif
+					for (; i < n; ++i) dst[i] = half_to_float(s[i]);
+				}
+
+				inline void narrow(std::size_t n, const float* src, half* dst) {
+					std::size_t i = 0;
+					auto d = reinterpret_cast<std::uint16_t*>(dst);
+#if defined(__AVX512F__)
+					for (; i + 16 <= n; i += 16) _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#elif defined(__F16C__)
+					for (; i + 8 <= n; i += 8) _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+					for (; i < n; ++i) d[i] = float_to_half(src[i]);
+				}
+
+				inline void widen(std::size_t n, const bfloat16* src, float* dst) {
+					std::size_t i = 0;
+					auto s = reinterpret_cast<const std::uint16_t*>(src);
+#if defined(__AVX512F__)
+					for (; i + 16 <= n; i += 16) {
+						__m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)));
+						_mm512_storeu_ps(dst + i, _mm512_castsi512_ps(_mm512_slli_epi32(x, 16)));
+					}
+#elif defined(__AVX2__)
+					for (; i + 8 <= n; i += 8) {
+						__m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+						_mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(x, 16)));
+					}
+#endif
+					for (; i < n; ++i) dst[i] = bfloat16_to_float(s[i]);
+				}
+
+				//integer rounding as in float_to_bfloat16, so that the vector and scalar paths agree bit for bit
+				inline void narrow(std::size_t n, const float* src, bfloat16* dst) {
+					std::size_t i = 0;
+					auto d = reinterpret_cast<std::uint16_t*>(dst);
+#if defined(__AVX512F__)
+					for (; i + 16 <= n; i += 16) {
+						__m512 v = _mm512_loadu_ps(src + i);
+						__m512i x = _mm512_castps_si512(v);
+						__m512i odd = _mm512_and_si512(_mm512_srli_epi32(x, 16), _mm512_set1_epi32(1));
+						__m512i r = _mm512_srli_epi32(_mm512_add_epi32(x, _mm512_add_epi32(odd, _mm512_set1_epi32(0x7FFF))), 16);
+						__m512i q = _mm512_or_si512(_mm512_srli_epi32(x, 16), _mm512_set1_epi32(0x40));
+						r = _mm512_mask_mov_epi32(r, _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q), q);
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), _mm512_cvtepi32_epi16(r));
+					}
+#elif defined(__AVX2__)
+					for (; i + 8 <= n; i += 8) {
+						__m256 v = _mm256_loadu_ps(src + i);
+						__m256i x = _mm256_castps_si256(v);
+						__m256i odd = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+						__m256i r = _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_add_epi32(odd, _mm256_set1_epi32(0x7FFF))), 16);
+						__m256i q = _mm256_or_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0x40));
+						r = _mm256_blendv_epi8(r, q, _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q)));
+						//pack the low halves of the 32-bit lanes, packus works within 128-bit lanes so the qwords are reordered after
+						__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm256_castsi256_si128(packed));
+					}
+#endif
+					for (; i < n; ++i) d[i] = float_to_bfloat16(src[i]);
+				}
+
+				//double goes through a float block on the stack, the double <-> float loops are vectorized by the compiler
+				constexpr std::size_t block = 256;
+
+				template <class S>
+				void widen(std::size_t n, const S* src, double* dst) {
+					float buffer[block];
+					for (std::size_t begin = 0; begin < n; begin += block) {
+						std::size_t m = n - begin < block ? n - begin : block;
+						widen(m, src + begin, buffer);
+						for (std::size_t i = 0; i < m; ++i) dst[begin + i] = static_cast<double>(buffer[i]);
+					}
+				}
+
+				template <class S>
+				void narrow(std::size_t n, const double* src, S* dst) {
+					float buffer[block];
+					for (std::size_t begin = 0; begin < n; begin += block) {
+						std::size_t m = n - begin < block ? n - begin : block;
+						for (std::size_t i = 0; i < m; ++i) buffer[i] = static_cast<float>(src[begin + i]);
+						narrow(m, buffer, dst + begin);
+					}
+				}
+			}
+
+			//converts n elements between a storage format and float or double, or between float and double
+			template <class From, class To, std::enable_if_t<convertible<From, To>, int> = 0>
+			void convert(std::size_t n, const From* src, To* dst) {
+				if constexpr (is_storage<From>::value) detail::widen(n, src, dst);
+				else if constexpr (is_storage<To>::value) detail::narrow(n, src, dst);
+				else for (std::size_t i = 0; i < n; ++i) dst[i] = static_cast<To>(src[i]);
+			}
+
+			//the same, split over n_threads, 0 choosing the number of threads from the size as the copy engine does
+			template <class From, class To, std::enable_if_t<convertible<From, To>, int> = 0>
+			void convert(std::size_t n, const From* src, To* dst, std::size_t n_threads) {
+				n_threads = copy_engine::detail::threads_for(n * (sizeof(From) + sizeof(To)), n_threads);
+				parallel::for_each_chunk(n, n_threads, [=](std::size_t, std::size_t begin, std::size_t end) {
+					convert(end - begin, src + begin, dst + begin);
+					});
+			}
+
+			//history records kept in a storage format
+
+			//writes x into the current record of h and advances it
+			template <class S, class T, class Alloc, std::size_t A, std::enable_if_t<convertible<T, S>, int> = 0>
+			void push(history::HistoryBase<S>& h, const ArrayCPU<T, Alloc, A>& x, std::size_t n_threads = 0) {
+				if (x.size_ != h.single_size()) throw std::logic_error("push can not be done with an array of a different size than the records");
+				convert(x.size_, x.pointer(), h.current(), n_threads);
+				h.push();
+			}
+
+			//reads the record at pos, following the convention of HistoryBase::at
+			template <class S, class T, class Alloc, std::size_t A, std::enable_if_t<convertible<S, T>, int> = 0>
+			void load(const history::HistoryBase<S>& h, std::ptrdiff_t pos, ArrayCPU<T, Alloc, A>& x, std::size_t n_threads = 0) {
+				if (x.size_ < h.single_size()) throw std::logic_error("load can not be done into an array smaller than the records");
+				convert(h.single_size(), h.cat(pos), x.pointer(), n_threads);
+			}
+		}
+
+		//storage arrays, float storage for double fields is DArrayDDR<float>
+		template <std::size_t A = 64>
+		using DArrayDDRHalf = DArrayDDR<precision::half, A>;
+
+		template <std::size_t A = 64>
+		using DArrayDDRBFloat16 = DArrayDDR<precision::bfloat16, A>;
+
+		//array_copy between CPU arrays of a storage format and of float or double, converting on the way
+		//the overload in array_wrapper_gpu.h covers arrays of the same element type
+		template<
+			class DstArrayT, class SrcArrayT,
+			std::enable_if_t<
+			std::is_base_of<ArrayCPUBase, DstArrayT>::value && std::is_base_of<ArrayCPUBase, SrcArrayT>::value &&
+			precision::convertible<
+			std::decay_t<std::remove_pointer_t< decltype(std::declval<const SrcArrayT&>().pointer())>>,
+			std::decay_t<std::remove_pointer_t< decltype(std::declval<DstArrayT&>().pointer())>>
+			>, int> = 0
+		>
+			void array_copy(DstArrayT& dst, const SrcArrayT& src, size_t shift = 0) {
+			if (dst.size_ < (src.size_ + shift)) throw std::logic_error("array_copy can not be done from a larger array to a smaller one");
+			precision::convert(src.size_, src.pointer(), dst.pointer() + shift, 0);
+		}
+	}
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../parallel.h"
+#include "../history.h"
+#include "array_wrapper_cpu.h"
+#include "kernel.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace reduction {
+			//the range is cut into blocks of block_size elements, independently of the number of threads
+			//each block is reduced sequentially and the partial results are combined along a fixed binary tree
+			//hence the result is bitwise identical for any n_threads
+			constexpr std::size_t block_size = 8192;
+
+			//a reducer provides result_type, size(), identity(), block(begin, end), combine(a, b) and finalize(a)
+			//several reducers passed to reduce() share one sweep over the blocks, so every block is read from memory once
+
+			template <class T>
+			struct Sum {
+				using result_type = T;
+				const T* x;
+				std::size_t n;
+				[[nodiscard]] std::size_t size() const noexcept { return n; }
+				[[nodiscard]] result_type identity() const { return T(); }
+				[[nodiscard]] result_type block(std::size_t begin, std::size_t end) const {
+					T ans = T();
+					for (std::size_t i = begin; i < end; ++i) ans += x[i];
+					return ans;
+				}
+				[[nodiscard]] static result_type combine(const result_type& a, const result_type& b) { return a + b; }
+				[[nodiscard]] static result_type finalize(const result_type& a) { return a; }
+			};
+
+			template <class T>
+			struct Dot {
+				using result_type = T;
+				const T* x;
+				const T* y;
+				std::size_t n;
+				[[nodiscard]] std::size_t size() const noexcept { return n; }
+				[[nodiscard]] result_type identity() const { return T(); }
+				[[nodiscard]] result_type block(std::size_t begin, std::size_t end) const { return kernel::dot(end - begin, x + begin, y + begin); }
+				[[nodiscard]] static result_type combine(const result_type& a, const result_type& b) { return a + b; }
+				[[nodiscard]] static result_type finalize(const result_type& a) { return a; }
+			};
+
+			template <class T>
+			struct MaxAbs {
+				using result_type = decltype(std::abs(std::declval<T>()));
+				const T* x;
+				std::size_t n;
+				[[nodiscard]] std::size_t size() const noexcept { return n; }
+				[[nodiscard]] result_type identity() const { return result_type(0); }
+				[[nodiscard]] result_type block(std::size_t begin, std::size_t end) const { return kernel::norm_inf(end - begin, x + begin); }
+				[[nodiscard]] static result_type combine(const result_type& a, const result_type& b) { return a > b ? a : b; }
+				[[nodiscard]] static result_type finalize(const result_type& a) { return a; }
+			};
+
+			template <class T>
+			struct Norm2 {
+				using result_type = decltype(std::abs(std::declval<T>()));
+				const T* x;
+				std::size_t n;
+				[[nodiscard]] std::size_t size() const noexcept { return n; }
+				[[nodiscard]] result_type identity() const { return result_type(0); }
+				[[nodiscard]] result_type block(std::size_t begin, std::size_t end) const {
+					if constexpr (std::is_arithmetic<T>::value) return kernel::dot(end - begin, x + begin, x + begin);
+					else {
+						result_type ans = 0;
+						for (std::size_t i = begin; i < end; ++i) ans += std::norm(x[i]);
+						return ans;
+					}
+				}
+				[[nodiscard]] static result_type combine(const result_type& a, const result_type& b) { return a + b; }
+				[[nodiscard]] static result_type finalize(const result_type& a) { return std::sqrt(a); }
+			};
+
+			namespace detail {
+				template <class R, class V>
+				V combine_tree(const std::vector<V>& partials, std::size_t begin, std::size_t end) {
+					if (end - begin == 1) return partials[begin];
+					auto mid = begin + (end - begin) / 2;
+					return R::combine(combine_tree<R>(partials, begin, mid), combine_tree<R>(partials, mid, end));
+				}
+
+				template <class... Rs, std::size_t... Is>
+				auto reduce_impl(std::size_t n_threads, std::index_sequence<Is...>, const Rs&... rs) {
+					auto reducers = std::forward_as_tuple(rs...);
+					std::size_t n = std::get<0>(reducers).size();
+					if (((rs.size() != n) || ...))
+						throw std::logic_error("Fused reduction can not be done over ranges of different sizes");
+					if (n == 0) return std::make_tuple(Rs::finalize(rs.identity())...);
+					std::size_t n_blocks = (n + block_size - 1) / block_size;
+					std::tuple<std::vector<typename Rs::result_type>...> partials{ std::vector<typename Rs::result_type>(n_blocks)... };
+					parallel::for_each_chunk(n_blocks, n_threads, [&](std::size_t, std::size_t block_begin, std::size_t block_end) {
+						for (std::size_t b = block_begin; b < block_end; ++b) {
+							std::size_t begin = b * block_size;
+							std::size_t end = begin + block_size < n ? begin + block_size : n;
+							((std::get<Is>(partials)[b] = std::get<Is>(reducers).block(begin, end)), ...);
+						}
+						});
+					return std::make_tuple(Rs::finalize(combine_tree<Rs>(std::get<Is>(partials), 0, n_blocks))...);
+				}
+			}
+
+			//reduce all reducers in one sweep, n_threads = 0 uses parallel::default_threads()
+			template <class... Rs>
+			[[nodiscard]] auto reduce(std::size_t n_threads, const Rs&... rs) {
+				static_assert(sizeof...(Rs) > 0, "At least one reducer is required");
+				return detail::reduce_impl(n_threads, std::index_sequence_for<Rs...>{}, rs...);
+			}
+
+			//reducers over raw ranges
+
+			template <class T>
+			[[nodiscard]] Sum<T> sum_of(const T* x, std::size_t n) { return { x, n }; }
+			template <class T>
+			[[nodiscard]] Dot<T> dot_of(const T* x, const T* y, std::size_t n) { return { x, y, n }; }
+			template <class T>
+			[[nodiscard]] MaxAbs<T> max_abs_of(const T* x, std::size_t n) { return { x, n }; }
+			template <class T>
+			[[nodiscard]] Norm2<T> norm2_of(const T* x, std::size_t n) { return { x, n }; }
+
+			//reducers over arrays and views, e.g. the fields of a FieldBundle
+
+			template <class X, std::enable_if_t<kernel::detail::is_array<X>, int> = 0>
+			[[nodiscard]] Sum<kernel::detail::element_t<X>> sum_of(const X& x) { return { x.pointer(), x.size_ }; }
+			template <class X, class Y, std::enable_if_t<kernel::detail::same_elements<X, Y>, int> = 0>
+			[[nodiscard]] Dot<kernel::detail::element_t<X>> dot_of(const X& x, const Y& y) {
+				if (x.size_ != y.size_) throw std::logic_error("dot can not be done between two arrays of different sizes");
+				return { x.pointer(), y.pointer(), x.size_ };
+			}
+			template <class X, std::enable_if_t<kernel::detail::is_array<X>, int> = 0>
+			[[nodiscard]] MaxAbs<kernel::detail::element_t<X>> max_abs_of(const X& x) { return { x.pointer(), x.size_ }; }
+			template <class X, std::enable_if_t<kernel::detail::is_array<X>, int> = 0>
+			[[nodiscard]] Norm2<kernel::detail::element_t<X>> norm2_of(const X& x) { return { x.pointer(), x.size_ }; }
+
+			//reducers over history records, pos follows the convention of HistoryBase::at
+
+			template <class T>
+			[[nodiscard]] Sum<T> sum_of(const history::HistoryBase<T>& h, std::ptrdiff_t pos) { return { h.at(pos), h.single_size() }; }
+			template <class T>
+			[[nodiscard]] Dot<T> dot_of(const history::HistoryBase<T>& h, std::ptrdiff_t pos1, std::ptrdiff_t pos2) { return { h.at(pos1), h.at(pos2), h.single_size() }; }
+			template <class T>
+			[[nodiscard]] MaxAbs<T> max_abs_of(const history::HistoryBase<T>& h, std::ptrdiff_t pos) { return { h.at(pos), h.single_size() }; }
+			template <class T>
+			[[nodiscard]] Norm2<T> norm2_of(const history::HistoryBase<T>& h, std::ptrdiff_t pos) { return { h.at(pos), h.single_size() }; }
+
+			//single reductions
+
+			template <class... Args>
+			[[nodiscard]] auto sum(const Args&... args) { return std::get<0>(reduce(0, sum_of(args...))); }
+			template <class... Args>
+			[[nodiscard]] auto dot(const Args&... args) { return std::get<0>(reduce(0, dot_of(args...))); }
+			template <class... Args>
+			[[nodiscard]] auto max_abs(const Args&... args) { return std::get<0>(reduce(0, max_abs_of(args...))); }
+			template <class... Args>
+			[[nodiscard]] auto norm2(const Args&... args) { return std::get<0>(reduce(0, norm2_of(args...))); }
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "boost/align.hpp"
+#include "array_wrapper_cpu.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		//tag: the content is not preserved, so growing beyond the capacity allocates without copying
+		struct discard_t { explicit discard_t() = default; };
+		inline constexpr discard_t discard{};
+
+		//array with a capacity separate from its size, every reallocation keeps the alignment A
+		//size_ is a read-only reference to the current size, so that code written for ArrayCPU keeps working
+		//pointers obtained from the array are invalidated by any operation that grows it beyond capacity() or by shrink_to_fit()
+		template<class T, class Allocator, size_t A>
+		class ResizableArray : ArrayCPUBase {
+		public:
+			using allocator_type = detail::default_init_allocator<Allocator>;
+			using storage_type = std::vector<T, allocator_type>;
+
+			ResizableArray() : size_(current_size_), data_(), current_size_(0) {	}
+			ResizableArray(std::size_t S) : size_(current_size_), data_(S, T()), current_size_(S) {	}
+			ResizableArray(const T& val, std::size_t S) : size_(current_size_), data_(S, val), current_size_(S) {	}
+			ResizableArray(std::size_t S, uninitialized_t) : size_(current_size_), data_(S), current_size_(S) {	}
+			template<typename OtherT, typename OtherAlloc>
+			ResizableArray(const std::vector<OtherT, OtherAlloc>& v, std::size_t S) : size_(current_size_), data_(detail::duplicate<T, allocator_type>(v, S)), current_size_(S) {	}
+			ResizableArray(const ResizableArray& rhs) : size_(current_size_), data_(rhs.data_), current_size_(rhs.current_size_) {	}
+			ResizableArray(ResizableArray&& rhs) : size_(current_size_), data_(std::move(rhs.data_)), current_size_(rhs.current_size_) {
+				rhs.data_.clear();
+				rhs.current_size_ = 0;
+			}
+			//unlike ArrayCPU, assignments adopt the size of rhs
+			ResizableArray& operator=(const ResizableArray& rhs) {
+				if (this == &rhs) return *this;
+				resize(rhs.size_, discard);
+				std::memcpy(pointer(), rhs.pointer(), sizeof(T) * rhs.size_);
+				return *this;
+			}
+			ResizableArray& operator=(ResizableArray&& rhs) {
+				data_.swap(rhs.data_);
+				std::swap(current_size_, rhs.current_size_);
+				return *this;
+			}
+			template <class E, class = std::enable_if_t<std::is_base_of<ExpressionBase, E>::value>>
+			ResizableArray& operator=(const E& e) {
+				//e may refer to this array, so a resized result is evaluated into a new buffer
+				//expressions of scalars only report size -1, see expression::any_size
+				if (e.size() == static_cast<std::size_t>(-1) || e.size() == size_) view() = e;
+				else {
+					ResizableArray tmp(e.size(), uninitialized);
+					tmp.view() = e;
+					*this = std::move(tmp);
+				}
+				return *this;
+			}
+
+			//keeps the first min(S, size_) elements, new elements are value-initialized or set to val
+			void resize(std::size_t S) { resize(S, T()); }
+			void resize(std::size_t S, const T& val) {
+				data_.resize(S, val);
+				current_size_ = S;
+			}
+			//keeps the first min(S, size_) elements, new elements are default-initialized
+			void resize(std::size_t S, uninitialized_t) {
+				data_.resize(S);
+				current_size_ = S;
+			}
+			//nothing is kept, no element is copied even if a reallocation happens
+			void resize(std::size_t S, discard_t) {
+				if (S > data_.capacity()) {
+					storage_type fresh;
+					fresh.reserve(S);
+					data_.swap(fresh);
+				}
+				data_.resize(S);
+				current_size_ = S;
+			}
+			void reserve(std::size_t capacity) { data_.reserve(capacity); }
+			//releases the capacity beyond size_, always reallocating if there is any
+			void shrink_to_fit() {
+				if (data_.capacity() == current_size_) return;
+				storage_type fitted;
+				fitted.reserve(current_size_);
+				fitted.assign(data_.begin(), data_.end());
+				data_.swap(fitted);
+			}
+			[[nodiscard]] std::size_t capacity() const noexcept { return data_.capacity(); }
+
+			operator T* () { return pointer(); }
+			operator const T* () const { return pointer(); }
+			T* operator+(size_t shift) { return pointer() + shift; }
+			const T* operator+(size_t shift) const { return pointer() + shift; }
+
+			const std::size_t& size_;
+			constexpr static std::size_t Alignment = A;
+
+			inline const T* pointer() const { return data_.data(); }
+			inline T* pointer() { return data_.data(); }
+			inline const T& operator[](size_t pos) const { return data_[pos]; }
+			inline T& operator[](size_t pos) { return data_[pos]; }
+
+			//fixed size view of the current content, for the functions written for ArrayCPU
+			[[nodiscard]] ArrayCPUView<T, A> view() { return ArrayCPUView<T, A>(pointer(), current_size_); }
+			[[nodiscard]] ArrayCPUView<const T, A> view() const { return ArrayCPUView<const T, A>(pointer(), current_size_); }
+
+		protected:
+			storage_type data_;
+			std::size_t current_size_;
+		};
+
+		template <class T, std::size_t A = 64>
+		using DArrayDDRResizable = ResizableArray<T, boost::alignment::aligned_allocator<T, A>, A>;
+	}
+}
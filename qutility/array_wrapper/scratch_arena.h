@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "boost/align.hpp"
+#include "array_wrapper_cpu.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		//bump allocator for short-lived kernel temporaries
+		//memory is handed out as ArrayCPUView with uninitialized elements, and returned all at once when the enclosing Scope ends
+		//chunks are kept for reuse, so after the first few calls a kernel allocates nothing
+		//high_water_mark() tells how much to reserve() at startup so that a single chunk suffices
+		class ScratchArena {
+		public:
+			constexpr static std::size_t Alignment = 64;
+			constexpr static std::size_t min_chunk_bytes = std::size_t(1) << 16;
+
+			//position of the bump pointer, everything allocated after it is released together
+			struct marker {
+				std::size_t chunk;
+				std::size_t offset;
+				std::size_t used;
+			};
+
+			//restores the arena to its state at construction when destroyed
+			class Scope {
+			public:
+				explicit Scope(ScratchArena& arena) : arena_(arena), marker_(arena.mark()) {}
+				Scope(const Scope&) = delete;
+				Scope& operator=(const Scope&) = delete;
+				~Scope() { arena_.release(marker_); }
+			private:
+				ScratchArena& arena_;
+				marker marker_;
+			};
+
+			explicit ScratchArena(std::size_t initial_bytes = 0) { if (initial_bytes) reserve(initial_bytes); }
+			ScratchArena(const ScratchArena&) = delete;
+			ScratchArena& operator=(const ScratchArena&) = delete;
+
+			//the arena of the calling thread
+			static ScratchArena& local() {
+				thread_local ScratchArena arena;
+				return arena;
+			}
+
+			[[nodiscard]] Scope scope() { return Scope(*this); }
+
+			template <class T>
+			[[nodiscard]] ArrayCPUView<T, Alignment> allocate(std::size_t n) {
+				static_assert(std::is_trivially_destructible<T>::value, "Elements in the scratch arena are never destroyed");
+				static_assert(alignof(T) <= Alignment, "The scratch arena only guarantees 64-byte alignment");
+				return ArrayCPUView<T, Alignment>(static_cast<T*>(allocate_bytes(n * sizeof(T))), n);
+			}
+
+			[[nodiscard]] void* allocate_bytes(std::size_t bytes) {
+				bytes = round_up(bytes ? bytes : 1);
+				while (current_ < chunks_.size() && offset_ + bytes > chunks_[current_].bytes) {
+					//the rest of this chunk is skipped, but not counted as used
+					++current_;
+					offset_ = 0;
+				}
+				if (current_ == chunks_.size()) {
+					std::size_t last = chunks_.empty() ? min_chunk_bytes : chunks_.back().bytes;
+					add_chunk(bytes > 2 * last ? bytes : 2 * last);
+					offset_ = 0;
+				}
+				void* p = chunks_[current_].data.get() + offset_;
+				offset_ += bytes;
+				used_ += bytes;
+				if (used_ > high_water_) high_water_ = used_;
+				return p;
+			}
+
+			[[nodiscard]] marker mark() const noexcept { return { current_, offset_, used_ }; }
+			void release(const marker& m) noexcept {
+				current_ = m.chunk;
+				offset_ = m.offset;
+				used_ = m.used;
+			}
+
+			//merges all chunks into one of at least bytes, only possible when nothing is in use
+			void reserve(std::size_t bytes) {
+				if (used_ != 0) return;
+				bytes = round_up(bytes);
+				if (chunks_.size() == 1 && chunks_[0].bytes >= bytes) return;
+				chunks_.clear();
+				add_chunk(bytes);
+				current_ = 0;
+				offset_ = 0;
+			}
+
+			[[nodiscard]] std::size_t used() const noexcept { return used_; }
+			[[nodiscard]] std::size_t high_water_mark() const noexcept { return high_water_; }
+			[[nodiscard]] std::size_t capacity() const noexcept {
+				std::size_t ans = 0;
+				for (auto& c : chunks_) ans += c.bytes;
+				return ans;
+			}
+
+		private:
+			struct aligned_free {
+				void operator()(char* p) const { boost::alignment::aligned_free(p); }
+			};
+			struct chunk {
+				std::unique_ptr<char, aligned_free> data;
+				std::size_t bytes;
+			};
+
+			static std::size_t round_up(std::size_t bytes) { return (bytes + Alignment - 1) / Alignment * Alignment; }
+
+			void add_chunk(std::size_t bytes) {
+				auto p = static_cast<char*>(boost::alignment::aligned_alloc(Alignment, bytes));
+				if (!p) throw std::bad_alloc();
+				chunks_.push_back({ std::unique_ptr<char, aligned_free>(p), bytes });
+			}
+
+			std::vector<chunk> chunks_;
+			std::size_t current_ = 0;
+			std::size_t offset_ = 0;
+			std::size_t used_ = 0;
+			std::size_t high_water_ = 0;
+		};
+	}
+}
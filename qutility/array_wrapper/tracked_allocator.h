@@ -0,0 +1,228 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "boost/align.hpp"
+#include "array_wrapper_cpu.h"
+#include "hbw_posix_allocator.h"
+
+//define QUTILITY_DISABLE_MEMORY_TRACKING to turn TrackedAllocator into a plain alias of the wrapped allocator
+//the query functions below are kept and report zeros in that case
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace tracking {
+			//a tag is a type providing static const char* name(), allocations are accounted per name
+			struct untagged { static constexpr const char* name() { return "untagged"; } };
+
+			struct statistics {
+				std::size_t live_bytes = 0;
+				std::size_t peak_bytes = 0;
+				std::size_t allocations = 0;
+				std::size_t deallocations = 0;
+			};
+
+			//thrown when an allocation would push the live bytes of all tracked allocators over the budget
+			class budget_exceeded : public std::bad_alloc {
+			public:
+				explicit budget_exceeded(std::string what) : what_(std::move(what)) {}
+				const char* what() const noexcept override { return what_.c_str(); }
+			private:
+				std::string what_;
+			};
+
+			namespace detail {
+				struct counters {
+					std::atomic<std::size_t> live{ 0 };
+					std::atomic<std::size_t> peak{ 0 };
+					std::atomic<std::size_t> allocations{ 0 };
+					std::atomic<std::size_t> deallocations{ 0 };
+
+					//fails without side effects if the live bytes would exceed budget, 0 meaning no budget
+					bool add(std::size_t bytes, std::size_t budget = 0) {
+						auto now = live.load(std::memory_order_relaxed);
+						do {
+							if (budget && now + bytes > budget) return false;
+						} while (!live.compare_exchange_weak(now, now + bytes, std::memory_order_relaxed));
+						now += bytes;
+						auto old = peak.load(std::memory_order_relaxed);
+						while (now > old && !peak.compare_exchange_weak(old, now, std::memory_order_relaxed));
+						allocations.fetch_add(1, std::memory_order_relaxed);
+						return true;
+					}
+					void remove(std::size_t bytes) {
+						live.fetch_sub(bytes, std::memory_order_relaxed);
+						deallocations.fetch_add(1, std::memory_order_relaxed);
+					}
+					statistics load() const {
+						return { live.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed),
+							allocations.load(std::memory_order_relaxed), deallocations.load(std::memory_order_relaxed) };
+					}
+				};
+
+				//parses "1048576", "512M", "16G" and so on, 0 means no budget
+				inline std::size_t parse_bytes(const char* s) {
+					if (!s || !*s) return 0;
+					char* end = nullptr;
+					auto ans = static_cast<std::size_t>(std::strtoull(s, &end, 10));
+					switch (*end) {
+					case 'k': case 'K': return ans << 10;
+					case 'm': case 'M': return ans << 20;
+					case 'g': case 'G': return ans << 30;
+					case 't': case 'T': return ans << 40;
+					default: return ans;
+					}
+				}
+
+				//leaked on purpose, so that arrays with static storage duration can still be freed at exit
+				class Registry {
+				public:
+					static Registry& instance() {
+						static Registry* registry = new Registry();
+						return *registry;
+					}
+					counters& tag(const char* name) {
+						std::lock_guard<std::mutex> lock(mutex_);
+						for (auto& t : tags_)
+							if (t.first == name) return *t.second;
+						tags_.emplace_back(name, std::make_unique<counters>());
+						return *tags_.back().second;
+					}
+					template <class F>
+					void for_each_tag(F&& f) {
+						std::lock_guard<std::mutex> lock(mutex_);
+						for (auto& t : tags_) f(t.first, t.second->load());
+					}
+					counters total;
+					std::atomic<std::size_t> budget;
+				private:
+					Registry() : budget(parse_bytes(std::getenv("QUTILITY_MEMORY_BUDGET"))) {}
+					std::mutex mutex_;
+					std::vector<std::pair<std::string, std::unique_ptr<counters>>> tags_;
+				};
+
+				template <class Tag>
+				counters& tag_counters() {
+					static counters& c = Registry::instance().tag(Tag::name());
+					return c;
+				}
+			}
+
+#ifndef QUTILITY_DISABLE_MEMORY_TRACKING
+			constexpr bool enabled = true;
+
+			template <class Tag>
+			[[nodiscard]] statistics stats() { return detail::tag_counters<Tag>().load(); }
+			[[nodiscard]] inline statistics stats(const std::string& name) { return detail::Registry::instance().tag(name.c_str()).load(); }
+			[[nodiscard]] inline statistics total() { return detail::Registry::instance().total.load(); }
+
+			//limit on the live bytes of all tracked allocators, 0 for none
+			//the initial value is taken from the environment variable QUTILITY_MEMORY_BUDGET, e.g. QUTILITY_MEMORY_BUDGET=48G
+			inline void set_budget(std::size_t bytes) { detail::Registry::instance().budget.store(bytes); }
+			[[nodiscard]] inline std::size_t budget() { return detail::Registry::instance().budget.load(); }
+
+			//one line per tag with live and peak bytes and the number of allocations
+			[[nodiscard]] inline std::string report() {
+				std::ostringstream oss;
+				auto line = [&oss](const std::string& name, const statistics& s) {
+					oss << name << ": live " << s.live_bytes << " bytes, peak " << s.peak_bytes << " bytes, "
+						<< s.allocations << " allocations, " << s.deallocations << " deallocations\n";
+				};
+				auto& registry = detail::Registry::instance();
+				registry.for_each_tag(line);
+				line("total", registry.total.load());
+				if (auto b = registry.budget.load()) oss << "budget: " << b << " bytes\n";
+				return oss.str();
+			}
+#else
+			constexpr bool enabled = false;
+
+			template <class Tag>
+			[[nodiscard]] statistics stats() { return {}; }
+			[[nodiscard]] inline statistics stats(const std::string&) { return {}; }
+			[[nodiscard]] inline statistics total() { return {}; }
+			inline void set_budget(std::size_t) {}
+			[[nodiscard]] inline std::size_t budget() { return 0; }
+			[[nodiscard]] inline std::string report() { return "memory tracking is disabled\n"; }
+#endif
+		}
+
+#ifndef QUTILITY_DISABLE_MEMORY_TRACKING
+		//wraps Allocator, accounting every allocation to Tag and to the process-wide total
+		//an allocation over the budget throws tracking::budget_exceeded carrying the report, before the upstream allocator is called
+		template <class Allocator, class Tag = tracking::untagged>
+		class TrackedAllocator : public Allocator {
+		public:
+			using value_type = typename std::allocator_traits<Allocator>::value_type;
+			using size_type = std::size_t;
+			using difference_type = std::ptrdiff_t;
+
+			template <class U>
+			struct rebind {
+				using other = TrackedAllocator<typename std::allocator_traits<Allocator>::template rebind_alloc<U>, Tag>;
+			};
+
+			TrackedAllocator() = default;
+			TrackedAllocator(const Allocator& upstream) : Allocator(upstream) {}
+			template <class U>
+			TrackedAllocator(const TrackedAllocator<U, Tag>& rhs) : Allocator(static_cast<const U&>(rhs)) {}
+
+			[[nodiscard]] value_type* allocate(size_type n) {
+				auto bytes = n * sizeof(value_type);
+				auto& registry = tracking::detail::Registry::instance();
+				auto budget = registry.budget.load(std::memory_order_relaxed);
+				if (!registry.total.add(bytes, budget)) {
+					std::ostringstream oss;
+					oss << "Allocation of " << bytes << " bytes for tag " << Tag::name()
+						<< " exceeds the memory budget of " << budget << " bytes\n" << tracking::report();
+					throw tracking::budget_exceeded(oss.str());
+				}
+				value_type* p;
+				try { p = std::allocator_traits<Allocator>::allocate(*this, n); }
+				catch (...) {
+					registry.total.remove(bytes);
+					throw;
+				}
+				tracking::detail::tag_counters<Tag>().add(bytes);
+				return p;
+			}
+
+			void deallocate(value_type* p, size_type n) {
+				std::allocator_traits<Allocator>::deallocate(*this, p, n);
+				tracking::detail::Registry::instance().total.remove(n * sizeof(value_type));
+				tracking::detail::tag_counters<Tag>().remove(n * sizeof(value_type));
+			}
+		};
+
+		template <class Alloc1, class Alloc2, class Tag>
+		bool operator==(const TrackedAllocator<Alloc1, Tag>& lhs, const TrackedAllocator<Alloc2, Tag>& rhs) {
+			return static_cast<const Alloc1&>(lhs) == static_cast<const Alloc2&>(rhs);
+		}
+
+		template <class Alloc1, class Alloc2, class Tag>
+		bool operator!=(const TrackedAllocator<Alloc1, Tag>& lhs, const TrackedAllocator<Alloc2, Tag>& rhs) {
+			return !(lhs == rhs);
+		}
+#else
+		template <class Allocator, class Tag = tracking::untagged>
+		using TrackedAllocator = Allocator;
+#endif
+
+		template <class T, class Tag = tracking::untagged, std::size_t A = 64>
+		using DArrayDDRTracked = ArrayCPU<T, TrackedAllocator<boost::alignment::aligned_allocator<T, A>, Tag>, A>;
+
+		template <class T, class Tag = tracking::untagged, std::size_t A = 64>
+		using DArrayHBWTracked = ArrayCPU<T, TrackedAllocator<hbw::allocator<T, A>, Tag>, A>;
+	}
+}
+
+//declares a tag type whose name is its identifier, e.g. QUTILITY_MEMORY_TAG(history);
+#define QUTILITY_MEMORY_TAG(tag) struct tag { static constexpr const char* name() { return #tag; } }
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "../c_array.h"
+#include "array_wrapper_cpu.h"
+
+namespace qutility {
+	namespace array_wrapper {
+		namespace view {
+			template <std::size_t N>
+			using index_type = c_array::c_array<std::size_t, N>;
+
+			//strides of a contiguous row-major (C order) array of the given shape
+			template <std::size_t N>
+			constexpr index_type<N> row_major_strides(index_type<N> const& shape) {
+				auto reversed = c_array::reverse(shape);
+				index_type<N> ans{};
+				std::size_t acc = 1;
+				for (std::size_t itr = 0; itr < N; ++itr) {
+					ans[itr] = acc;
+					acc *= reversed[itr];
+				}
+				return c_array::reverse(ans);
+			}
+
+			template <std::size_t N>
+			constexpr std::size_t product(index_type<N> const& shape) {
+				std::size_t ans = 1;
+				for (std::size_t itr = 0; itr < N; ++itr) ans *= shape[itr];
+				return ans;
+			}
+
+			template <std::size_t... Es>
+			struct extents {
+				constexpr static std::size_t rank = sizeof...(Es);
+				constexpr static index_type<rank> value{ { Es... } };
+			};
+
+			template <std::size_t... Ss>
+			struct strides {
+				constexpr static std::size_t rank = sizeof...(Ss);
+				constexpr static index_type<rank> value{ { Ss... } };
+			};
+
+			namespace detail {
+				template <class Extents, class Seq>
+				struct row_major_impl;
+				template <class Extents, std::size_t... Is>
+				struct row_major_impl<Extents, std::index_sequence<Is...>> {
+					using type = strides<row_major_strides(Extents::value)[Is]...>;
+				};
+
+				constexpr std::size_t swapped(std::size_t itr, std::size_t d0, std::size_t d1) {
+					return itr == d0 ? d1 : (itr == d1 ? d0 : itr);
+				}
+
+				template <class Extents, class Strides, std::size_t D0, std::size_t D1, class Seq>
+				struct transposed_impl;
+				template <class Extents, class Strides, std::size_t D0, std::size_t D1, std::size_t... Is>
+				struct transposed_impl<Extents, Strides, D0, D1, std::index_sequence<Is...>> {
+					using extents_type = extents<Extents::value[swapped(Is, D0, D1)]...>;
+					using strides_type = strides<Strides::value[swapped(Is, D0, D1)]...>;
+				};
+			}
+
+			template <class Extents>
+			using row_major = typename detail::row_major_impl<Extents, std::make_index_sequence<Extents::rank>>::type;
+		}
+
+		//non-owning view of N-dimensional data with runtime extents and strides (in elements)
+		template <class T, std::size_t N>
+		class View {
+			static_assert(N > 0, "A view needs at least one dimension");
+		public:
+			using index_type = view::index_type<N>;
+			constexpr static std::size_t rank = N;
+
+			View(T* data, index_type const& shape) : data_(data), shape_(shape), strides_(view::row_major_strides(shape)) {}
+			View(T* data, index_type const& shape, index_type const& strides) : data_(data), shape_(shape), strides_(strides) {}
+			template <class U, class = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+			View(View<U, N> const& rhs) : data_(rhs.data()), shape_(rhs.shape()), strides_(rhs.strides()) {}
+
+			template <class... Is, class = std::enable_if_t<sizeof...(Is) == N>>
+			inline T& operator()(Is... idx) const { return data_[c_array::inner_product(index_type{ { static_cast<std::size_t>(idx)... } }, strides_)]; }
+			inline T& operator[](index_type const& idx) const { return data_[c_array::inner_product(idx, strides_)]; }
+
+			[[nodiscard]] T* data() const noexcept { return data_; }
+			[[nodiscard]] index_type const& shape() const noexcept { return shape_; }
+			[[nodiscard]] index_type const& strides() const noexcept { return strides_; }
+			[[nodiscard]] std::size_t extent(std::size_t d) const { return shape_[d]; }
+			[[nodiscard]] std::size_t size() const { return view::product(shape_); }
+			[[nodiscard]] bool is_contiguous() const { return strides_ == view::row_major_strides(shape_); }
+
+			//sub-block starting at offset with the given extent, sharing the data
+			[[nodiscard]] View block(index_type const& offset, index_type const& extent) const {
+				for (std::size_t d = 0; d < N; ++d)
+					if (offset[d] + extent[d] > shape_[d]) throw std::out_of_range("Block exceeds the extent of the view");
+				return View(data_ + c_array::inner_product(offset, strides_), extent, strides_);
+			}
+			//the range [begin, end) along dimension d
+			[[nodiscard]] View slice(std::size_t d, std::size_t begin, std::size_t end) const {
+				if (end < begin) throw std::invalid_argument("Slice must not end before it begins");
+				index_type offset{}, extent = shape_;
+				offset[d] = begin;
+				extent[d] = end - begin;
+				return block(offset, extent);
+			}
+			//every step-th element along dimension d
+			[[nodiscard]] View stride(std::size_t d, std::size_t step) const {
+				if (step == 0) throw std::invalid_argument("Stride step must be positive");
+				auto shape = shape_;
+				auto strides = strides_;
+				shape[d] = (shape_[d] + step - 1) / step;
+				strides[d] *= step;
+				return View(data_, shape, strides);
+			}
+			[[nodiscard]] View transpose(std::size_t d0, std::size_t d1) const {
+				auto shape = shape_;
+				auto strides = strides_;
+				std::swap(shape[d0], shape[d1]);
+				std::swap(strides[d0], strides[d1]);
+				return View(data_, shape, strides);
+			}
+			//dimension d of the result is dimension order[d] of this view
+			[[nodiscard]] View permute(index_type const& order) const {
+				index_type shape{}, strides{};
+				for (std::size_t d = 0; d < N; ++d) {
+					shape[d] = shape_[order[d]];
+					strides[d] = strides_[order[d]];
+				}
+				return View(data_, shape, strides);
+			}
+			//splits every dimension d into (shape[d] / tile[d], tile[d]), giving a 2N dimensional view for blocked loops
+			[[nodiscard]] View<T, 2 * N> tile(index_type const& tile) const {
+				c_array::c_array<c_array::c_array<std::size_t, 2>, N> shape{}, strides{};
+				for (std::size_t d = 0; d < N; ++d) {
+					if (tile[d] == 0 || shape_[d] % tile[d] != 0) throw std::logic_error("Tile shape must divide the extent of the view");
+					shape[d] = { { shape_[d] / tile[d], tile[d] } };
+					strides[d] = { { strides_[d] * tile[d], strides_[d] } };
+				}
+				return View<T, 2 * N>(data_, c_array::flattern(shape), c_array::flattern(strides));
+			}
+
+		private:
+			T* data_;
+			index_type shape_;
+			index_type strides_;
+		};
+
+		//non-owning view whose extents and strides are known at compile time
+		//the index arithmetic then only multiplies by constants, which the compiler strength-reduces
+		template <class T, class Extents, class Strides = view::row_major<Extents>>
+		class StaticView {
+			static_assert(Extents::rank > 0 && Extents::rank == Strides::rank, "Extents and strides must have the same non-zero rank");
+		public:
+			constexpr static std::size_t rank = Extents::rank;
+			using index_type = view::index_type<rank>;
+			constexpr static index_type shape_ = Extents::value;
+			constexpr static index_type strides_ = Strides::value;
+			constexpr static std::size_t Size = view::product(Extents::value);
+
+			explicit StaticView(T* data) : data_(data) {}
+
+			template <class... Is, class = std::enable_if_t<sizeof...(Is) == rank>>
+			inline T& operator()(Is... idx) const { return data_[c_array::inner_product(index_type{ { static_cast<std::size_t>(idx)... } }, strides_)]; }
+			inline T& operator[](index_type const& idx) const { return data_[c_array::inner_product(idx, strides_)]; }
+
+			[[nodiscard]] T* data() const noexcept { return data_; }
+			[[nodiscard]] constexpr static index_type shape() noexcept { return shape_; }
+			[[nodiscard]] constexpr static index_type strides() noexcept { return strides_; }
+			[[nodiscard]] constexpr static std::size_t extent(std::size_t d) { return shape_[d]; }
+			[[nodiscard]] constexpr static std::size_t size() { return Size; }
+
+			operator View<T, rank>() const { return View<T, rank>(data_, shape_, strides_); }
+
+			//sub-block of compile-time extent starting at a runtime offset
+			template <std::size_t... Es>
+			[[nodiscard]] StaticView<T, view::extents<Es...>, Strides> block(index_type const& offset) const {
+				static_assert(sizeof...(Es) == rank, "The block must have the same rank as the view");
+				for (std::size_t d = 0; d < rank; ++d)
+					if (offset[d] + view::extents<Es...>::value[d] > shape_[d]) throw std::out_of_range("Block exceeds the extent of the view");
+				return StaticView<T, view::extents<Es...>, Strides>(data_ + c_array::inner_product(offset, strides_));
+			}
+			[[nodiscard]] View<T, rank> block(index_type const& offset, index_type const& extent) const {
+				return View<T, rank>(*this).block(offset, extent);
+			}
+			template <std::size_t D0, std::size_t D1>
+			[[nodiscard]] auto transpose() const {
+				static_assert(D0 < rank && D1 < rank, "Dimension out of range");
+				using impl = view::detail::transposed_impl<Extents, Strides, D0, D1, std::make_index_sequence<rank>>;
+				return StaticView<T, typename impl::extents_type, typename impl::strides_type>(data_);
+			}
+
+		private:
+			T* data_;
+		};
+
+		//views over ArrayCPU storage, the shape must fit into the array
+
+		template <class T, class Alloc, std::size_t A, std::size_t N>
+		[[nodiscard]] View<T, N> make_view(ArrayCPU<T, Alloc, A>& arr, view::index_type<N> const& shape) {
+			if (view::product(shape) > arr.size_) throw std::logic_error("View can not be larger than the underlying array");
+			return View<T, N>(arr.pointer(), shape);
+		}
+
+		template <class T, class Alloc, std::size_t A, std::size_t N>
+		[[nodiscard]] View<const T, N> make_view(const ArrayCPU<T, Alloc, A>& arr, view::index_type<N> const& shape) {
+			if (view::product(shape) > arr.size_) throw std::logic_error("View can not be larger than the underlying array");
+			return View<const T, N>(arr.pointer(), shape);
+		}
+
+		template <std::size_t... Es, class T, class Alloc, std::size_t A>
+		[[nodiscard]] StaticView<T, view::extents<Es...>> make_view(ArrayCPU<T, Alloc, A>& arr) {
+			if (view::product(view::extents<Es...>::value) > arr.size_) throw std::logic_error("View can not be larger than the underlying array");
+			return StaticView<T, view::extents<Es...>>(arr.pointer());
+		}
+
+		template <std::size_t... Es, class T, class Alloc, std::size_t A>
+		[[nodiscard]] StaticView<const T, view::extents<Es...>> make_view(const ArrayCPU<T, Alloc, A>& arr) {
+			if (view::product(view::extents<Es...>::value) > arr.size_) throw std::logic_error("View can not be larger than the underlying array");
+			return StaticView<const T, view::extents<Es...>>(arr.pointer());
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace qutility {
+	namespace history {
+		enum class read_status {
+			ok,
+			not_published, //the record has not been published yet
+			overwritten //the slot was reused by a newer record before or while the record was read
+		};
+
+		//history with one producer and any number of concurrent readers, over caller-supplied storage as HistoryBase
+		//every slot carries a sequence number: 2n + 1 while record n is written into it and 2n + 2 once it is published
+		//the producer never waits, readers check the sequence number before and after they read a slot
+		//as with any seqlock, a reader may see a partially written record, which the second check reports as overwritten
+		template <typename T>
+		class ConcurrentHistory {
+			static_assert(std::is_trivially_copyable<T>::value, "Records of a concurrent history are copied bytewise");
+		public:
+			//a record read in place, valid() must be checked after the last access to data
+			struct View {
+				const T* data;
+				size_t record;
+				const std::atomic<std::uint64_t>* sequence;
+				[[nodiscard]] bool valid() const noexcept {
+					std::atomic_thread_fence(std::memory_order_acquire);
+					return data && sequence->load(std::memory_order_relaxed) == 2 * record + 2;
+				}
+			};
+
+			ConcurrentHistory() = delete;
+			ConcurrentHistory(const ConcurrentHistory&) = delete;
+			ConcurrentHistory& operator= (const ConcurrentHistory&) = delete;
+			ConcurrentHistory(T* const& base_ptr, size_t const& single_size, size_t const& N_hist)
+				:base_ptr_(base_ptr), single_size_(single_size), N_hist_(N_hist), sequences_(new slot[N_hist]) {
+				if (N_hist == 0) throw std::invalid_argument("A history requires at least one record");
+			}
+
+			//producer side, only one thread may call these
+
+			//the slot of the next record, readers of the record previously held there see it as overwritten from now on
+			[[nodiscard]] T* begin_write() noexcept {
+				auto s = N_record_ % N_hist_;
+				sequences_[s].sequence.store(2 * N_record_ + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				return base_ptr_ + s * single_size_;
+			}
+			//makes the record obtained from begin_write() visible to readers
+			void publish() noexcept {
+				sequences_[N_record_ % N_hist_].sequence.store(2 * N_record_ + 2, std::memory_order_release);
+				++N_record_;
+				published_.store(N_record_, std::memory_order_release);
+			}
+			void push(const T* record) noexcept {
+				std::memcpy(begin_write(), record, sizeof(T) * single_size_);
+				publish();
+			}
+
+			//reader side
+
+			//number of records published so far, record n is the (n + 1)-th one pushed
+			[[nodiscard]] size_t published() const noexcept { return published_.load(std::memory_order_acquire); }
+
+			//copies record n into dst
+			read_status read(size_t n, T* dst) const noexcept {
+				if (n >= published()) return read_status::not_published;
+				auto& sequence = sequences_[n % N_hist_].sequence;
+				auto before = sequence.load(std::memory_order_acquire);
+				if (before != 2 * n + 2) return read_status::overwritten;
+				std::memcpy(dst, base_ptr_ + (n % N_hist_) * single_size_, sizeof(T) * single_size_);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				return sequence.load(std::memory_order_relaxed) == before ? read_status::ok : read_status::overwritten;
+			}
+
+			//copies the newest k records into dst, newest first, each record taking single_size elements
+			//the number of records copied is returned, it is smaller than k if fewer are available or older ones were overwritten
+			//records[i] receives the record number of the i-th copy if records is given
+			size_t read_latest(size_t k, T* dst, size_t* records = nullptr) const noexcept {
+				size_t n = published();
+				if (k > n) k = n;
+				if (k > N_hist_) k = N_hist_;
+				for (size_t i = 0; i < k; ++i) {
+					if (read(n - 1 - i, dst + i * single_size_) != read_status::ok) return i;
+					if (records) records[i] = n - 1 - i;
+				}
+				return k;
+			}
+
+			//record n without copying, nullptr data if it is not published or already overwritten
+			[[nodiscard]] View view(size_t n) const noexcept {
+				auto& sequence = sequences_[n % N_hist_].sequence;
+				if (n >= published() || sequence.load(std::memory_order_acquire) != 2 * n + 2) return { nullptr, n, &sequence };
+				return { base_ptr_ + (n % N_hist_) * single_size_, n, &sequence };
+			}
+
+			[[nodiscard]] auto single_size() const { return single_size_; }
+			[[nodiscard]] auto N_hist() const { return N_hist_; }
+
+		private:
+			//one cache line per slot, so that readers polling one slot do not disturb the producer writing another
+			struct alignas(64) slot {
+				std::atomic<std::uint64_t> sequence{ 0 };
+			};
+
+			T* const base_ptr_;
+			size_t const single_size_;
+			size_t const N_hist_;
+			std::unique_ptr<slot[]> sequences_;
+			size_t N_record_ = 0; //producer copy of published_
+			alignas(64) std::atomic<size_t> published_{ 0 };
+		};
+	}
+}
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <stdexcept>
+#include <type_traits>
 
 namespace qutility {
 	namespace history {
@@ -32,25 +38,99 @@ namespace qutility {
 			[[nodiscard]] inline const T* clatter(T* const& base_ptr, size_t const& single_size, size_t const& N_hist, size_t const& N_record) noexcept {
 				return latter(base_ptr, single_size, N_hist, N_record);
 			}
-			template<typename T>
-			[[nodiscard]] inline T* at(T* const& base_ptr, size_t const& single_size, size_t const& N_hist, size_t const& N_record, ptrdiff_t const& pos) {
+			//the messages are built out of line, so that the checks in at() stay cheap
+			[[noreturn]] inline void throw_at_out_of_range(size_t N_hist, size_t N_record, ptrdiff_t pos) {
 				if (pos >= (ptrdiff_t)N_hist)
 					throw std::invalid_argument(
 						std::string("At most ") + std::to_string(N_hist) + " record(s) allowed"
 					);
-				if (-pos > (ptrdiff_t)(N_hist > N_record ? N_record : N_hist))
-					throw std::invalid_argument(
-						std::string("Record ") + std::to_string(pos) + " requested while there are only "
-						+ std::to_string(N_hist > N_record ? N_record : N_hist) + " record(s) avaliable."
-					);
+				throw std::invalid_argument(
+					std::string("Record ") + std::to_string(pos) + " requested while there are only "
+					+ std::to_string(N_hist > N_record ? N_record : N_hist) + " record(s) avaliable."
+				);
+			}
+			template<typename T>
+			[[nodiscard]] inline T* at(T* const& base_ptr, size_t const& single_size, size_t const& N_hist, size_t const& N_record, ptrdiff_t const& pos) {
+				if (pos >= (ptrdiff_t)N_hist || -pos > (ptrdiff_t)(N_hist > N_record ? N_record : N_hist))
+					throw_at_out_of_range(N_hist, N_record, pos);
 				return base_ptr + (((ptrdiff_t)N_record + pos) % N_hist) * single_size;
 			}
 			template<typename T>
 			[[nodiscard]] inline const T* cat(T* const& base_ptr, size_t const& single_size, size_t const& N_hist, size_t const& N_record, ptrdiff_t const& pos) {
 				return at(base_ptr, single_size, N_hist, N_record, pos);
 			}
+
+			//header of a saved history: magic, element type, single_size, N_hist, N_record, number of records that follow
+			//all fields are 64-bit, so that files are exchangeable between 32-bit and 64-bit builds
+			constexpr std::uint64_t checkpoint_magic = 0x5148495354000001; //"QHIST", version 1
+			constexpr size_t checkpoint_header_size = 6;
+			//size of the element, with flags for floating point, integral and signed types
+			template<typename T>
+			constexpr std::uint64_t type_code() noexcept {
+				return sizeof(T) | (std::uint64_t(std::is_floating_point<T>::value) << 16) | (std::uint64_t(std::is_integral<T>::value) << 17) | (std::uint64_t(std::is_signed<T>::value) << 18);
+			}
 		}
 
+		//cursor over consecutive records in chronological order (Forward) or reverse chronological order
+		//it advances by one slot with a wrap-around test, no modulo is computed after construction
+		template <typename T, bool Forward>
+		class RecordCursor {
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = T*;
+			using difference_type = ptrdiff_t;
+			using pointer = T* const*;
+			using reference = T*;
+
+			RecordCursor() = default;
+			RecordCursor(T* base_ptr, size_t single_size, size_t N_hist, size_t slot, size_t remaining) noexcept
+				:base_ptr_(base_ptr), single_size_(single_size), N_hist_(N_hist), slot_(slot), remaining_(remaining) {}
+
+			[[nodiscard]] T* operator*() const noexcept { return base_ptr_ + slot_ * single_size_; }
+			RecordCursor& operator++() noexcept {
+				if constexpr (Forward) {
+					if (++slot_ == N_hist_) slot_ = 0;
+				}
+				else {
+					slot_ = (slot_ == 0 ? N_hist_ : slot_) - 1;
+				}
+				--remaining_;
+				return *this;
+			}
+			RecordCursor operator++(int) noexcept {
+				auto ans = *this;
+				++*this;
+				return ans;
+			}
+			//cursors of one range are equal when the same number of records is left
+			[[nodiscard]] bool operator==(const RecordCursor& rhs) const noexcept { return remaining_ == rhs.remaining_; }
+			[[nodiscard]] bool operator!=(const RecordCursor& rhs) const noexcept { return remaining_ != rhs.remaining_; }
+
+			[[nodiscard]] size_t slot() const noexcept { return slot_; }
+			[[nodiscard]] size_t remaining() const noexcept { return remaining_; }
+
+		private:
+			T* base_ptr_ = nullptr;
+			size_t single_size_ = 0;
+			size_t N_hist_ = 1;
+			size_t slot_ = 0;
+			size_t remaining_ = 0;
+		};
+
+		template <typename T, bool Forward>
+		class RecordRange {
+		public:
+			using iterator = RecordCursor<T, Forward>;
+			RecordRange(iterator first, size_t size) noexcept :first_(first), size_(size) {}
+			[[nodiscard]] iterator begin() const noexcept { return first_; }
+			[[nodiscard]] iterator end() const noexcept { return iterator(); }
+			[[nodiscard]] size_t size() const noexcept { return size_; }
+			[[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+		private:
+			iterator first_;
+			size_t size_;
+		};
+
 		template <typename T>
 		class HistoryBase {
 		public:
@@ -86,7 +166,84 @@ namespace qutility {
 			[[nodiscard]] auto single_size() const { return single_size_; }
 			[[nodiscard]] auto N_hist() const { return N_hist_; }
 
+			//at(pos) without the range checks, pos must lie in [-available(), N_hist)
+			[[nodiscard]] T* unchecked_at(ptrdiff_t pos) const noexcept { return base_ptr_ + ((size_t)((ptrdiff_t)N_record_ + pos) % N_hist_) * single_size_; }
+			[[nodiscard]] const T* unchecked_cat(ptrdiff_t pos) const noexcept { return unchecked_at(pos); }
+
+			//the last n (by default all available) records, oldest first or newest first
+			[[nodiscard]] RecordRange<T, true> oldest_first(size_t n = static_cast<size_t>(-1)) const noexcept {
+				n = clamp_window(n);
+				return { RecordCursor<T, true>(base_ptr_, single_size_, N_hist_, (N_record_ - n) % N_hist_, n), n };
+			}
+			[[nodiscard]] RecordRange<T, false> newest_first(size_t n = static_cast<size_t>(-1)) const noexcept {
+				n = clamp_window(n);
+				return { RecordCursor<T, false>(base_ptr_, single_size_, N_hist_, (N_record_ + N_hist_ - 1) % N_hist_, n), n };
+			}
+
+			//writes the header and the available records, oldest first, as raw bytes
+			//throws std::runtime_error if the stream fails
+			void save(std::ofstream& ofs) const {
+				std::uint64_t header[detail::checkpoint_header_size] = { detail::checkpoint_magic, detail::type_code<T>(), single_size_, N_hist_, N_record_, available() };
+				ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+				for (const T* record : oldest_first())
+					ofs.write(reinterpret_cast<const char*>(record), static_cast<std::streamsize>(sizeof(T) * single_size_));
+				ofs.flush();
+				if (!ofs) throw std::runtime_error("The history could not be written.");
+			}
+			void save(const std::string& filename) const {
+				std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+				if (!ofs) throw std::runtime_error("The file " + filename + " could not be opened for writing.");
+				save(ofs);
+			}
+			//reads a history written by save(), the element type and single_size must agree
+			//if N_hist is smaller than when saved, only the newest records are kept
+			//N_record is restored, unless this history holds more records than were saved, then it restarts at the number of records read
+			//throws std::runtime_error on a bad header or a short read, the history is left empty if records were already overwritten
+			void load(std::ifstream& ifs) {
+				std::uint64_t header[detail::checkpoint_header_size];
+				if (!ifs.read(reinterpret_cast<char*>(header), sizeof(header)))
+					throw std::runtime_error("The file is too short for the header of a saved history.");
+				if (header[0] != detail::checkpoint_magic)
+					throw std::runtime_error("The file does not contain a saved history.");
+				if (header[1] != detail::type_code<T>())
+					throw std::runtime_error("The saved history has records of another element type.");
+				if (header[2] != single_size_)
+					throw std::runtime_error(
+						std::string("Records of ") + std::to_string(header[2]) + " element(s) saved while this history has "
+						+ std::to_string(single_size_) + " element(s) per record."
+					);
+				constexpr auto size_max = std::numeric_limits<size_t>::max();
+				if (header[4] > size_max || header[5] > header[4] || header[5] > header[3])
+					throw std::runtime_error("The header of the saved history is inconsistent.");
+				size_t N_record = static_cast<size_t>(header[4]);
+				size_t n_saved = static_cast<size_t>(header[5]);
+				size_t n_kept = n_saved < N_hist_ ? n_saved : N_hist_;
+				const size_t record_bytes = sizeof(T) * single_size_;
+				if (single_size_ != 0 && n_saved - n_kept > static_cast<size_t>(std::numeric_limits<std::streamoff>::max()) / record_bytes)
+					throw std::runtime_error("The saved history is too large to be skipped.");
+				if (!ifs.seekg(static_cast<std::streamoff>((n_saved - n_kept) * record_bytes), std::ios::cur))
+					throw std::runtime_error("The file is too short for the saved history.");
+				if ((N_record < N_hist_ ? N_record : N_hist_) != n_kept) N_record = n_kept;
+				for (size_t i = 0; i < n_kept; ++i) {
+					if (!ifs.read(reinterpret_cast<char*>(base_ptr_ + ((N_record - n_kept + i) % N_hist_) * single_size_), static_cast<std::streamsize>(record_bytes))) {
+						N_record_ = 0;
+						throw std::runtime_error("The file is too short for the saved history.");
+					}
+				}
+				N_record_ = N_record;
+			}
+			void load(const std::string& filename) {
+				std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+				if (!ifs) throw std::runtime_error("The file " + filename + " could not be opened for reading.");
+				load(ifs);
+			}
+
 		protected:
+			[[nodiscard]] size_t clamp_window(size_t n) const noexcept {
+				auto ans = available();
+				return n < ans ? n : ans;
+			}
+
 			T* const base_ptr_;
 			size_t const single_size_;
 			size_t const N_hist_;
@@ -107,6 +264,32 @@ namespace qutility {
 			constexpr static size_t N_hist_ = NHist;
 			[[nodiscard]] constexpr auto single_size() const { return single_size_; }
 			[[nodiscard]] constexpr auto N_hist() const { return N_hist_; }
+
+			//the accessors below replace those of HistoryBase with the sizes known at compile time
+			//when NHist is a power of two the slot is obtained by a mask
+			[[nodiscard]] constexpr static size_t slot(size_t n) noexcept {
+				if constexpr ((NHist & (NHist - 1)) == 0) return n & (NHist - 1);
+				else return n % NHist;
+			}
+			[[nodiscard]] auto pos() const noexcept { return slot(this->N_record_); }
+			[[nodiscard]] T* current() const noexcept { return this->base_ptr_ + slot(this->N_record_) * SingleSize; }
+			[[nodiscard]] const T* ccurrent() const noexcept { return current(); }
+			[[nodiscard]] T* former() const {
+				if (this->N_record_ == 0)
+					throw std::invalid_argument("Cannot fetch the pointer to the former record of record No. 0.");
+				return this->base_ptr_ + slot(this->N_record_ - 1) * SingleSize;
+			}
+			[[nodiscard]] const T* cformer() const { return former(); }
+			[[nodiscard]] T* latter() const noexcept { return this->base_ptr_ + slot(this->N_record_ + 1) * SingleSize; }
+			[[nodiscard]] const T* clatter() const noexcept { return latter(); }
+			[[nodiscard]] T* at(intptr_t const& pos) const {
+				if (pos >= (ptrdiff_t)NHist || -pos > (ptrdiff_t)this->available())
+					detail::throw_at_out_of_range(NHist, this->N_record_, pos);
+				return unchecked_at(pos);
+			}
+			[[nodiscard]] const T* cat(intptr_t const& pos) const { return at(pos); }
+			[[nodiscard]] T* unchecked_at(ptrdiff_t pos) const noexcept { return this->base_ptr_ + slot((size_t)((ptrdiff_t)this->N_record_ + pos)) * SingleSize; }
+			[[nodiscard]] const T* unchecked_cat(ptrdiff_t pos) const noexcept { return unchecked_at(pos); }
 		};
 
 		template<typename T>
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace qutility {
+	namespace parallel {
+		//number of threads used whenever 0 is passed as n_threads
+		inline std::size_t default_threads() noexcept {
+			auto n = std::thread::hardware_concurrency();
+			return n == 0 ? 1 : n;
+		}
+
+		//the range [0, N) is cut into n_threads contiguous chunks whose boundaries only depend on N and n_threads
+		//chunk i is [chunk_begin(N, n, i), chunk_begin(N, n, i + 1))
+		[[nodiscard]] constexpr std::size_t chunk_begin(std::size_t N, std::size_t n_threads, std::size_t i) noexcept {
+			return (N / n_threads) * i + (i < N % n_threads ? i : N % n_threads);
+		}
+
+		//call f(thread_id, begin, end) for every chunk of [0, N), chunk 0 is processed by the calling thread
+		//the first exception thrown by any chunk is rethrown after all threads have joined
+		template <typename F>
+		void for_each_chunk(std::size_t N, std::size_t n_threads, F&& f) {
+			if (n_threads == 0) n_threads = default_threads();
+			if (n_threads > N) n_threads = N == 0 ? 1 : N;
+			if (n_threads == 1) {
+				f(std::size_t(0), std::size_t(0), N);
+				return;
+			}
+			std::vector<std::exception_ptr> errors(n_threads);
+			std::vector<std::thread> workers;
+			workers.reserve(n_threads - 1);
+			auto run = [&](std::size_t i) {
+				try {
+					f(i, chunk_begin(N, n_threads, i), chunk_begin(N, n_threads, i + 1));
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			};
+			for (std::size_t i = 1; i < n_threads; ++i)
+				workers.emplace_back(run, i);
+			run(0);
+			for (auto& w : workers) w.join();
+			for (auto& e : errors)
+				if (e) std::rethrow_exception(e);
+		}
+	}
+}
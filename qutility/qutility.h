@@ -6,6 +6,8 @@
 #include "matio.h"
 #include "traits.h"
 #include "ifmember.h"
+#include "parallel.h"
 #include "array_wrapper.h"
 #include "history.h"
+#include "concurrent_history.h"
 #include "getopt.h"
\ No newline at end of file